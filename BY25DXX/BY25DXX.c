@@ -1,7 +1,10 @@
 #include "BY25DXX.h"
+#include <stddef.h>
 
-#define PAGE_SIZE 256
-#define SECTOR_SIZE 4096
+#define PAGE_SIZE BY25DXX_PAGE_SIZE
+#define SECTOR_SIZE BY25DXX_SECTOR_SIZE
+#define SECTOR_FLOOR(addr) ((addr) - (addr) % SECTOR_SIZE)
+#define SECTOR_CEIL(addr) SECTOR_FLOOR((addr) + SECTOR_SIZE - 1)
 
 #undef true
 #define true 1
@@ -29,14 +32,61 @@
 #define CMD_GOTO_SLEEP 0xB9
 #define CMD_WAKEUP 0xAB
 
+#define TIME_RES1_US 3 // tRES1: release from deep power-down
+
+#ifdef BY25DXX_FLASH_SIZE
+#define TIME_CE_TYP (BY25DXX_FLASH_SIZE / 0x40000UL * 1000000UL) // 1s per 256KB
+#else
+#define TIME_CE_TYP 2000000UL
+#endif
+
+// operation the chip may be busy with
+#define OP_NONE 0
+#define OP_PROGRAM 1
+#define OP_ERASE_SECTOR 2
+#define OP_ERASE_HALF_BLOCK 3
+#define OP_ERASE_BLOCK 4
+#define OP_ERASE_CHIP 5
+#define OP_WRITE_STATUS 6
+#define OP_UNKNOWN 7
+
 #define CMD_RD_DEV_ID 0x90
 #define CMD_RD_JEDEC_ID 0x9F
 #define CMD_RD_UNIQUE_ID 0x4B
 
 //---------- internal macro --------------
 
-#define CS_LOW() BY25DXX_CS_LOW()
-#define CS_HIGH() BY25DXX_CS_HIGH()
+#ifdef BY25DXX_TRACE
+#define BUS_LOW()          \
+    do                     \
+    {                      \
+        TraceBegin();      \
+        BY25DXX_CS_LOW();  \
+    } while (0)
+#define BUS_HIGH()         \
+    do                     \
+    {                      \
+        BY25DXX_CS_HIGH(); \
+        TraceEnd();        \
+    } while (0)
+#define TRACE_BULK(size) TraceBulk(size)
+#else
+#define BUS_LOW() BY25DXX_CS_LOW()
+#define BUS_HIGH() BY25DXX_CS_HIGH()
+#define TRACE_BULK(size)
+#endif
+
+#ifdef BY25DXX_AUTO_SLEEP
+#define CS_LOW()          \
+    do                    \
+    {                     \
+        PowerActive();    \
+        BUS_LOW();        \
+    } while (0)
+#else
+#define CS_LOW() BUS_LOW()
+#endif
+#define CS_HIGH() BUS_HIGH()
 
 #define WP_LOW() BY25DXX_WP_LOW()
 #define WP_HIGH() BY25DXX_WP_HIGH()
@@ -45,19 +95,116 @@
 
 BY25DXX_SPIHook __spi_send_byte;
 
-void EnableWrite()
+#ifdef BY25DXX_TRACE
+
+static BY25DXX_SPIHook __spi_trace_hook; // the user hook, __spi_send_byte records
+static BY25DXX_TraceRecord __trace[BY25DXX_TRACE_SIZE];
+static uint32_t __traceCount;
+static uint8_t __traceOpen;
+
+static BY25DXX_TraceRecord *TraceCur(void)
 {
-    CS_LOW();
-    __spi_send_byte(CMD_WR_EN);
-    CS_HIGH();
+    return &__trace[(__traceCount - 1) % BY25DXX_TRACE_SIZE];
+}
+
+static void TraceBegin(void)
+{
+    BY25DXX_TraceRecord *rec;
+
+    __traceCount++;
+    rec = TraceCur();
+    rec->time = BY25DXX_TRACE_TICK();
+    rec->cmd = 0;
+    rec->len = 0;
+    rec->duration = 0;
+    __traceOpen = 1;
+}
+
+static void TraceEnd(void)
+{
+    BY25DXX_TraceRecord *rec = TraceCur();
+    uint32_t duration = BY25DXX_TRACE_TICK() - rec->time;
+
+    rec->duration = duration > 0xFFFF ? 0xFFFF : (uint16_t)duration;
+    rec->len = rec->len ? rec->len - 1 : 0; // the opcode isn't counted
+    __traceOpen = 0;
+}
+
+static void TraceBulk(uint32_t size)
+{
+    BY25DXX_TraceRecord *rec = TraceCur();
+
+    rec->len = rec->len + size > 0xFFFF ? 0xFFFF : rec->len + size;
+}
+
+static uint8_t TraceXfer(uint8_t dat)
+{
+    BY25DXX_TraceRecord *rec = TraceCur();
+
+    if (__traceOpen)
+    {
+        if (rec->len < 4) // opcode and address
+            rec->cmd |= (uint32_t)dat << (24 - rec->len * 8);
+
+        if (rec->len < 0xFFFF)
+            rec->len++;
+    }
+
+    return __spi_trace_hook(dat);
 }
 
-void WaitBusy()
+#endif
+
+// typical and maximum busy time of each operation, us
+static const uint32_t __busyTime[][2] = {
+    {0, 0},                           // none
+    {600, 2400},                      // tPP
+    {60000, 300000},                  // tSE
+    {150000, 1000000},                // tBE32
+    {250000, 1500000},                // tBE64
+    {TIME_CE_TYP, TIME_CE_TYP * 5},   // tCE
+    {5000, 15000},                    // tW
+    {0, TIME_CE_TYP * 5},             // unknown
+};
+
+static uint8_t __busyOp = OP_UNKNOWN; // the chip may still be busy after an MCU reset
+static BY25DXX_WaitHook __waitHook;
+static uint8_t __status; // copy of the status register without BUSY/WEL
+static const BY25DXX_BulkHook *__bulkHook;
+static uint32_t __pollInterval = BY25DXX_POLL_INTERVAL;
+
+#ifdef BY25DXX_AUTO_SLEEP
+
+static uint8_t __sleeping = true; // the chip may be left asleep across an MCU reset
+static uint32_t __idleTimeout = BY25DXX_IDLE_TIMEOUT;
+static uint32_t __lastAccess;
+static uint32_t __sleepStart;
+static BY25DXX_PowerStats __powerStats;
+
+// called before every transaction, wakes the chip up if needed
+static void PowerActive(void)
+{
+    uint32_t now = BY25DXX_GET_TICK();
+
+    if (__sleeping)
+    {
+        __sleeping = false;
+        BUS_LOW();
+        __spi_send_byte(CMD_WAKEUP);
+        BUS_HIGH();
+        BY25DXX_DELAY_US(TIME_RES1_US);
+        __powerStats.sleepTime += now - __sleepStart;
+    }
+
+    __lastAccess = now;
+}
+
+#endif
+
+void EnableWrite()
 {
     CS_LOW();
-    __spi_send_byte(CMD_RD_STATUS);
-    while ((__spi_send_byte(CMD_NOP) & STATUS_WR_BUSY))
-        ;
+    __spi_send_byte(CMD_WR_EN);
     CS_HIGH();
 }
 
@@ -78,21 +225,108 @@ uint8_t ReadStatus(uint8_t cmd)
     return status;
 }
 
-void WriteStatus(uint8_t cmd, uint8_t dat)
+#ifdef BY25DXX_GET_TICK
+// real time, whatever the hook did
+#define ELAPSED_US(start, sum) ((BY25DXX_GET_TICK() - (start)) * 1000)
+#else
+// the time requested from the hook, or counted by the spin
+#define ELAPSED_US(start, sum) (sum)
+#endif
+
+BY25DXX_ErrorCode WaitBusy()
 {
-    WaitBusy();
+    BY25DXX_ErrorCode err = BY25DXX_ERR_NONE;
+    uint32_t maxTime, elapsed = 0, polls = 0;
+#ifdef BY25DXX_GET_TICK
+    uint32_t start;
+#endif
+
+    if (__busyOp == OP_NONE)
+        return BY25DXX_ERR_NONE; // nothing has been started since the last wait
+
+    maxTime = __busyTime[__busyOp][1];
+#ifdef BY25DXX_GET_TICK
+    start = BY25DXX_GET_TICK();
+#endif
+
+    if (__waitHook == NULL)
+    {
+        // every 'BY25DXX_SPIN_POLLS_PER_MS' status reads count as 1 ms
+        CS_LOW();
+        __spi_send_byte(CMD_RD_STATUS);
+        while ((__spi_send_byte(CMD_NOP) & STATUS_WR_BUSY))
+        {
+            if (++polls < BY25DXX_SPIN_POLLS_PER_MS)
+                continue;
+
+            polls = 0;
+            elapsed += 1000;
+            if (ELAPSED_US(start, elapsed) > maxTime)
+            {
+                err = BY25DXX_ERR_TIMEOUT;
+                break;
+            }
+        }
+        CS_HIGH();
+    }
+    else
+    {
+        // sleep through the typical time, then poll with CS released
+        elapsed = __busyTime[__busyOp][0];
+        __waitHook(elapsed);
+
+        while (ReadStatus(CMD_RD_STATUS) & STATUS_WR_BUSY)
+        {
+            if (ELAPSED_US(start, elapsed) > maxTime)
+            {
+                err = BY25DXX_ERR_TIMEOUT;
+                break;
+            }
+
+            __waitHook(__pollInterval);
+            elapsed += __pollInterval;
+        }
+    }
+
+#ifdef BY25DXX_AUTO_SLEEP
+    __powerStats.busyTime += BY25DXX_GET_TICK() - start;
+#endif
+
+    if (err == BY25DXX_ERR_NONE)
+        __busyOp = OP_NONE;
+
+    return err;
+}
+
+BY25DXX_ErrorCode WriteStatus(uint8_t cmd, uint8_t dat)
+{
+    dat &= ~(STATUS_WR_BUSY | STATUS_WR_ENABLE);
+
+    if (dat == __status)
+        return BY25DXX_ERR_NONE; // no change, skip the write and its tW
+
+    if (WaitBusy() != BY25DXX_ERR_NONE)
+        return BY25DXX_ERR_TIMEOUT;
+
     EnableWrite();
     CS_LOW();
     __spi_send_byte(cmd);
     __spi_send_byte(dat);
     CS_HIGH();
+    __busyOp = OP_WRITE_STATUS;
+
+    __status = dat;
+
+    return BY25DXX_ERR_NONE;
 }
 
 uint8_t IsEmptyPage(uint32_t addr)
 {
     uint16_t pageRemain = PAGE_SIZE - (addr % PAGE_SIZE);
 
-    WaitBusy();
+    if (WaitBusy() != BY25DXX_ERR_NONE)
+        return false;
+
     CS_LOW();
     __spi_send_byte(CMD_RD_DATA);
     SendAddr(addr);
@@ -118,7 +352,9 @@ uint8_t IsEmptySector(uint32_t addr, uint32_t size)
     if (secRemain > size)
         secRemain = size;
 
-    WaitBusy();
+    if (WaitBusy() != BY25DXX_ERR_NONE)
+        return false;
+
     CS_LOW();
     __spi_send_byte(CMD_RD_DATA);
     SendAddr(addr);
@@ -137,17 +373,133 @@ uint8_t IsEmptySector(uint32_t addr, uint32_t size)
     return true;
 }
 
-void BY25DXX_WritePage(uint32_t addr, uint8_t *buf, uint16_t size)
+// true if erasing [u0, u1) destroys source data not copied yet
+static uint8_t IsCopyConflict(uint32_t u0, uint32_t u1, uint32_t src, uint32_t dst, uint32_t len, uint8_t backward)
+{
+    uint32_t lo, hi;
+
+    if (backward) // everything below u1 is still to be copied
+    {
+        lo = src;
+        hi = src + ((u1 < dst + len ? u1 : dst + len) - dst);
+    }
+    else // everything above u0
+    {
+        lo = src + ((u0 > dst ? u0 : dst) - dst);
+        hi = src + len;
+    }
+
+    return lo < hi && lo < u1 && u0 < hi;
+}
+
+// largest erase unit at 'pos' (its start, or its end going backward) inside [lo, hi),
+// return 0 if even a sector conflicts with the copy
+static uint32_t NextEraseUnit(uint32_t pos, uint32_t lo, uint32_t hi, uint32_t src, uint32_t dst, uint32_t len, uint8_t backward)
+{
+    static const uint32_t unit[3] = {BY25DXX_BLOCK_SIZE, BY25DXX_HALF_BLOCK_SIZE, SECTOR_SIZE};
+    uint32_t u0, u1, i;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (pos % unit[i] != 0)
+            continue;
+
+        u0 = backward ? pos - unit[i] : pos;
+        u1 = u0 + unit[i];
+
+        // blocks only where all of it is in the range, sectors may stick out
+        if (i < 2 && (u0 < lo || u1 > hi))
+            continue;
+
+        if (len == 0 || !IsCopyConflict(u0, u1, src, dst, len, backward))
+            return unit[i];
+    }
+
+    return 0;
+}
+
+// erase [addr, addr + size) if any byte of [from, to) in it isn't blank
+static BY25DXX_ErrorCode EraseUnit(uint32_t addr, uint32_t size, uint32_t from, uint32_t to)
+{
+    BY25DXX_EraseType type = BY25DXX_ERASE_SECTOR;
+    uint32_t chk;
+
+    if (from < addr)
+        from = addr;
+    if (to > addr + size)
+        to = addr + size;
+
+    for (chk = from; chk < to; chk += SECTOR_SIZE - chk % SECTOR_SIZE)
+    {
+        if (!IsEmptySector(chk, to - chk))
+            break;
+    }
+
+    if (chk >= to)
+        return BY25DXX_ERR_NONE; // blank already
+
+    if (size == BY25DXX_BLOCK_SIZE)
+        type = BY25DXX_ERASE_BLOCK;
+    else if (size == BY25DXX_HALF_BLOCK_SIZE)
+        type = BY25DXX_ERASE_HALF_BLOCK;
+
+    return BY25DXX_Erase(addr, type);
+}
+
+// copy [from, to) of the destination, page by page
+static BY25DXX_ErrorCode CopyPages(uint32_t from, uint32_t to, uint32_t src, uint32_t dst)
+{
+    uint8_t buf[PAGE_SIZE];
+    uint16_t n, i;
+
+    for (; from < to; from += n)
+    {
+        n = PAGE_SIZE - from % PAGE_SIZE;
+        if (n > to - from)
+            n = (uint16_t)(to - from);
+
+        if (BY25DXX_ReadBytes(src + (from - dst), buf, n) != BY25DXX_ERR_NONE)
+            return BY25DXX_ERR_TIMEOUT;
+
+        for (i = 0; i < n && buf[i] == 0xFF; i++)
+            ;
+
+        if (i == n)
+            continue; // blank source page, the destination is erased
+
+        if (BY25DXX_ProgramBytes(from, buf, n) != BY25DXX_ERR_NONE)
+            return BY25DXX_ERR_FAILED;
+    }
+
+    return BY25DXX_ERR_NONE;
+}
+
+BY25DXX_ErrorCode BY25DXX_WritePage(uint32_t addr, uint8_t *buf, uint16_t size)
 {
     uint16_t index;
-    WaitBusy();
+
+    if (WaitBusy() != BY25DXX_ERR_NONE)
+        return BY25DXX_ERR_TIMEOUT;
+
     EnableWrite();
     CS_LOW();
     __spi_send_byte(CMD_WR_DATA);
     SendAddr(addr);
-    for (index = 0; index < size; index++)
-        __spi_send_byte(buf[index]);
+    if (__bulkHook)
+    {
+        TRACE_BULK(size);
+        __bulkHook->start(NULL, buf, size);
+        __bulkHook->wait();
+    }
+    else
+    {
+        for (index = 0; index < size; index++)
+            __spi_send_byte(buf[index]);
+    }
     CS_HIGH();
+    __busyOp = OP_PROGRAM;
+
+    return BY25DXX_ERR_NONE;
 }
 
 //-----------------------------------------------
@@ -156,9 +508,19 @@ BY25DXX_ErrorCode BY25DXX_Init(BY25DXX_SPIHook spiHook)
 {
     BY25DXX_DeviceInfo devInfo;
 
+#ifdef BY25DXX_TRACE
+    __spi_trace_hook = spiHook;
+    __spi_send_byte = TraceXfer;
+#else
     __spi_send_byte = spiHook;
+#endif
 
-    BY25DXX_GetDeviceInfo(&devInfo);
+#ifdef BY25DXX_AUTO_SLEEP
+    __sleepStart = BY25DXX_GET_TICK();
+#endif
+
+    if (BY25DXX_GetDeviceInfo(&devInfo) != BY25DXX_ERR_NONE)
+        return BY25DXX_ERR_TIMEOUT;
 
 #ifdef BY25DXX_DEV_ID
     if (devInfo.vendorID != BY25DXX_VENDOR_ID || devInfo.devID != BY25DXX_DEV_ID)
@@ -168,13 +530,18 @@ BY25DXX_ErrorCode BY25DXX_Init(BY25DXX_SPIHook spiHook)
         return BY25DXX_ERR_FAILED;
 #endif
 
+    __status = ReadStatus(CMD_RD_STATUS) & ~(STATUS_WR_BUSY | STATUS_WR_ENABLE);
+
     return BY25DXX_ERR_NONE;
 }
 
 uint8_t BY25DXX_ReadByte(uint32_t addr)
 {
     uint8_t dat;
-    WaitBusy();
+
+    if (WaitBusy() != BY25DXX_ERR_NONE)
+        return 0xFF;
+
     CS_LOW();
     __spi_send_byte(CMD_RD_DATA);
     SendAddr(addr);
@@ -183,18 +550,26 @@ uint8_t BY25DXX_ReadByte(uint32_t addr)
     return dat;
 }
 
-void BY25DXX_WriteByte(uint32_t addr, uint8_t dat)
+BY25DXX_ErrorCode BY25DXX_WriteByte(uint32_t addr, uint8_t dat)
 {
+    if (BY25DXX_IsProtected(addr, 1))
+        return BY25DXX_ERR_PROTECTED;
+
     if (!IsEmptyPage(addr)) // is not a empty page
         BY25DXX_Erase(addr, BY25DXX_ERASE_SECTOR);
 
-    WaitBusy();
+    if (WaitBusy() != BY25DXX_ERR_NONE)
+        return BY25DXX_ERR_TIMEOUT;
+
     EnableWrite();
     CS_LOW();
     __spi_send_byte(CMD_WR_DATA);
     SendAddr(addr);
     __spi_send_byte(dat);
     CS_HIGH();
+    __busyOp = OP_PROGRAM;
+
+    return BY25DXX_ERR_NONE;
 }
 
 uint16_t BY25DXX_ReadWord(uint32_t addr)
@@ -203,36 +578,85 @@ uint16_t BY25DXX_ReadWord(uint32_t addr)
     return (dat << 8) | (uint16_t)BY25DXX_ReadByte(addr);
 }
 
-void BY25DXX_WriteWord(uint32_t addr, uint16_t word)
+BY25DXX_ErrorCode BY25DXX_WriteWord(uint32_t addr, uint16_t word)
 {
     uint8_t buf[2];
     buf[0] = (uint8_t)word;
     buf[1] = (uint8_t)(word >> 8);
-    BY25DXX_WriteBytes(addr, buf, 2);
+    return BY25DXX_WriteBytes(addr, buf, 2);
+}
+
+BY25DXX_ErrorCode BY25DXX_ReadBytes(uint32_t addr, uint8_t *buf, uint32_t size)
+{
+    if (BY25DXX_ReadBegin(addr, buf, size) != BY25DXX_ERR_NONE)
+        return BY25DXX_ERR_TIMEOUT;
+
+    BY25DXX_ReadEnd();
+
+    return BY25DXX_ERR_NONE;
+}
+
+uint8_t BY25DXX_IsEmpty(uint32_t addr, uint32_t size)
+{
+    uint32_t n;
+
+    while (size > 0)
+    {
+        n = SECTOR_SIZE - addr % SECTOR_SIZE;
+        if (n > size)
+            n = size;
+
+        if (!IsEmptySector(addr, n))
+            return false;
+
+        addr += n;
+        size -= n;
+    }
+
+    return true;
 }
 
-void BY25DXX_ReadBytes(uint32_t addr, uint8_t *buf, uint32_t size)
+BY25DXX_ErrorCode BY25DXX_ReadBegin(uint32_t addr, uint8_t *buf, uint32_t size)
 {
-    WaitBusy();
+    if (WaitBusy() != BY25DXX_ERR_NONE)
+        return BY25DXX_ERR_TIMEOUT;
+
     CS_LOW();
     __spi_send_byte(CMD_RD_DATA);
     SendAddr(addr);
 
+    if (__bulkHook)
+    {
+        TRACE_BULK(size);
+        __bulkHook->start(buf, NULL, size);
+        return BY25DXX_ERR_NONE;
+    }
+
     while (size--)
     {
         *buf = __spi_send_byte(CMD_NOP);
         buf++;
     }
 
+    return BY25DXX_ERR_NONE;
+}
+
+void BY25DXX_ReadEnd(void)
+{
+    if (__bulkHook)
+        __bulkHook->wait();
+
     CS_HIGH();
 }
 
-void BY25DXX_WriteBytes(uint32_t addr, uint8_t *buf, uint32_t size)
+BY25DXX_ErrorCode BY25DXX_WriteBytes(uint32_t addr, uint8_t *buf, uint32_t size)
 {
-    uint16_t pageRemain = PAGE_SIZE - (addr % PAGE_SIZE);
     uint32_t sectorRemain = SECTOR_SIZE - (addr % SECTOR_SIZE);
     uint32_t chkAddr = addr, chkSize = size;
 
+    if (BY25DXX_IsProtected(addr, size))
+        return BY25DXX_ERR_PROTECTED;
+
     // erase sector
 
     if (chkSize < sectorRemain)
@@ -240,8 +664,9 @@ void BY25DXX_WriteBytes(uint32_t addr, uint8_t *buf, uint32_t size)
 
     while (1)
     {
-        if (!IsEmptySector(chkAddr, sectorRemain))
-            BY25DXX_Erase(chkAddr, BY25DXX_ERASE_SECTOR);
+        if (!IsEmptySector(chkAddr, sectorRemain) &&
+            BY25DXX_Erase(chkAddr, BY25DXX_ERASE_SECTOR) != BY25DXX_ERR_NONE)
+            return BY25DXX_ERR_TIMEOUT;
 
         if (chkSize == sectorRemain)
         {
@@ -260,14 +685,23 @@ void BY25DXX_WriteBytes(uint32_t addr, uint8_t *buf, uint32_t size)
         }
     }
 
-    // write data
+    return BY25DXX_ProgramBytes(addr, buf, size);
+}
+
+BY25DXX_ErrorCode BY25DXX_ProgramBytes(uint32_t addr, uint8_t *buf, uint32_t size)
+{
+    uint16_t pageRemain = PAGE_SIZE - (addr % PAGE_SIZE);
+
+    if (BY25DXX_IsProtected(addr, size))
+        return BY25DXX_ERR_PROTECTED;
 
     if (size < pageRemain)
         pageRemain = size;
 
     while (1)
     {
-        BY25DXX_WritePage(addr, buf, pageRemain);
+        if (BY25DXX_WritePage(addr, buf, pageRemain) != BY25DXX_ERR_NONE)
+            return BY25DXX_ERR_TIMEOUT;
 
         if (size == pageRemain)
         {
@@ -286,69 +720,283 @@ void BY25DXX_WriteBytes(uint32_t addr, uint8_t *buf, uint32_t size)
                 pageRemain = size;
         }
     }
+
+    return BY25DXX_ERR_NONE;
 }
 
-void BY25DXX_Erase(uint32_t addr, BY25DXX_EraseType type)
+BY25DXX_ErrorCode BY25DXX_Erase(uint32_t addr, BY25DXX_EraseType type)
 {
-    WaitBusy();
+    uint32_t size;
+
+    switch (type)
+    {
+    case BY25DXX_ERASE_SECTOR:
+        size = SECTOR_SIZE;
+        break;
+    case BY25DXX_ERASE_HALF_BLOCK:
+        size = BY25DXX_HALF_BLOCK_SIZE;
+        break;
+    case BY25DXX_ERASE_BLOCK:
+        size = BY25DXX_BLOCK_SIZE;
+        break;
+    default:
+        size = 0; // whole chip, refused by the chip if anything is protected
+        break;
+    }
+
+#ifdef BY25DXX_FLASH_SIZE
+    if (size == 0 ? BY25DXX_IsProtected(0, BY25DXX_FLASH_SIZE) : BY25DXX_IsProtected(addr - addr % size, size))
+        return BY25DXX_ERR_PROTECTED;
+#endif
+
+    if (WaitBusy() != BY25DXX_ERR_NONE)
+        return BY25DXX_ERR_TIMEOUT;
+
     EnableWrite();
     CS_LOW();
     __spi_send_byte((uint8_t)type);
-    SendAddr(addr);
+    if (type != BY25DXX_ERASE_CHIP) // chip erase must not be followed by an address
+        SendAddr(addr);
     CS_HIGH();
+
+    switch (type)
+    {
+    case BY25DXX_ERASE_SECTOR:
+        __busyOp = OP_ERASE_SECTOR;
+        break;
+    case BY25DXX_ERASE_HALF_BLOCK:
+        __busyOp = OP_ERASE_HALF_BLOCK;
+        break;
+    case BY25DXX_ERASE_BLOCK:
+        __busyOp = OP_ERASE_BLOCK;
+        break;
+    default:
+        __busyOp = OP_ERASE_CHIP;
+        break;
+    }
+
+    return BY25DXX_ERR_NONE;
+}
+
+BY25DXX_ErrorCode BY25DXX_WaitReady(void)
+{
+    return WaitBusy();
+}
+
+BY25DXX_ErrorCode BY25DXX_CopyRange(uint32_t src, uint32_t dst, uint32_t len)
+{
+    uint8_t backward = dst > src; // copy the end first, its source is below
+    uint32_t lo = SECTOR_FLOOR(dst), hi = SECTOR_CEIL(dst + len);
+    uint32_t pos, addr, size;
+    BY25DXX_ErrorCode err;
+
+    if (len == 0 || src == dst)
+        return BY25DXX_ERR_NONE;
+
+    if (BY25DXX_IsProtected(dst, len))
+        return BY25DXX_ERR_PROTECTED;
+
+    // nothing is erased if a sector of the destination holds source data
+    // it still needs itself (overlap closer than a sector)
+    for (pos = lo; pos < hi; pos += SECTOR_SIZE)
+    {
+        if (IsCopyConflict(pos, pos + SECTOR_SIZE, src, dst, len, backward))
+            return BY25DXX_ERR_FAILED;
+    }
+
+    pos = backward ? hi : lo;
+
+    while (backward ? pos > lo : pos < hi)
+    {
+        size = NextEraseUnit(pos, dst, dst + len, src, dst, len, backward);
+        addr = backward ? pos - size : pos;
+
+        err = EraseUnit(addr, size, dst, dst + len);
+        if (err != BY25DXX_ERR_NONE)
+            return err;
+
+        err = CopyPages(addr > dst ? addr : dst, addr + size < dst + len ? addr + size : dst + len, src, dst);
+        if (err != BY25DXX_ERR_NONE)
+            return err;
+
+        pos = backward ? addr : addr + size;
+    }
+
+    return BY25DXX_ERR_NONE;
 }
 
-void BY25DXX_LockProtectBits(void)
+BY25DXX_ErrorCode BY25DXX_MoveRange(uint32_t src, uint32_t dst, uint32_t len)
 {
-    WriteStatus(CMD_WR_STATUS, ReadStatus(CMD_RD_STATUS) | 0x80);
+    uint32_t s0 = SECTOR_CEIL(src), s1 = SECTOR_FLOOR(src + len);
+    uint32_t d0 = SECTOR_FLOOR(dst), d1 = SECTOR_CEIL(dst + len);
+    uint32_t range[2][2], pos, size, i;
+    BY25DXX_ErrorCode err;
+
+    if (len == 0 || src == dst)
+        return BY25DXX_ERR_NONE;
+
+    if (BY25DXX_IsProtected(src, len))
+        return BY25DXX_ERR_PROTECTED;
+
+    err = BY25DXX_CopyRange(src, dst, len);
+    if (err != BY25DXX_ERR_NONE)
+        return err;
+
+    // erase the whole sectors of the source outside the destination
+    range[0][0] = s0;
+    range[0][1] = s1 < d0 ? s1 : d0;
+    range[1][0] = s0 > d1 ? s0 : d1;
+    range[1][1] = s1;
+
+    for (i = 0; i < 2; i++)
+    {
+        for (pos = range[i][0]; pos < range[i][1]; pos += size)
+        {
+            size = NextEraseUnit(pos, range[i][0], range[i][1], 0, 0, 0, false);
+
+            err = EraseUnit(pos, size, pos, pos + size);
+            if (err != BY25DXX_ERR_NONE)
+                return err;
+        }
+    }
+
+    return BY25DXX_ERR_NONE;
+}
+
+void BY25DXX_SetWaitHook(BY25DXX_WaitHook hook, uint32_t pollInterval)
+{
+    __waitHook = hook;
+    __pollInterval = pollInterval > 0 ? pollInterval : 1; // 0 would never time out
+}
+
+void BY25DXX_SetBulkHook(const BY25DXX_BulkHook *hook)
+{
+    __bulkHook = hook;
+}
+
+BY25DXX_ErrorCode BY25DXX_LockProtectBits(void)
+{
+    if (WriteStatus(CMD_WR_STATUS, __status | STATUS_WR_PROTECT) != BY25DXX_ERR_NONE)
+        return BY25DXX_ERR_TIMEOUT;
+
     WP_LOW(); // lock
+
+    return BY25DXX_ERR_NONE;
 }
 
-void BY25DXX_UnlockProtectBits(void)
+BY25DXX_ErrorCode BY25DXX_UnlockProtectBits(void)
 {
     WP_HIGH(); // Unlock
-    WriteStatus(CMD_WR_STATUS, ReadStatus(CMD_RD_STATUS) | 0x7F);
+    return WriteStatus(CMD_WR_STATUS, __status & ~STATUS_WR_PROTECT);
 }
 
 BY25DXX_ProtectSize BY25DXX_GetProtectSize(void)
 {
-    return (BY25DXX_ProtectSize)GET_PROTECT_BLOCK(ReadStatus(CMD_RD_STATUS));
+    return (BY25DXX_ProtectSize)GET_PROTECT_BLOCK(__status);
 }
 
-void BY25DXX_SetProtectSize(BY25DXX_ProtectSize size)
+BY25DXX_ErrorCode BY25DXX_SetProtectSize(BY25DXX_ProtectSize size)
 {
-    uint8_t status = ReadStatus(CMD_RD_STATUS);
+    uint8_t status = __status;
 
     // clear old bits, set new bits
     status &= 0xE3;
     status |= ((size & 0x07) << 2);
 
-    WriteStatus(CMD_WR_STATUS, status);
+    return WriteStatus(CMD_WR_STATUS, status);
 }
 
-void BY25DXX_ClearProtection(void)
+BY25DXX_ErrorCode BY25DXX_ClearProtection(void)
 {
-    BY25DXX_SetProtectSize((BY25DXX_ProtectSize)0x0);
+    return BY25DXX_SetProtectSize((BY25DXX_ProtectSize)0x0);
 }
 
-void BY25DXX_GotoSleep(void)
+uint8_t BY25DXX_IsProtected(uint32_t addr, uint32_t size)
 {
-    WaitBusy();
+#ifdef BY25DXX_FLASH_SIZE
+    uint8_t bp = GET_PROTECT_BLOCK(__status);
+    uint32_t hi;
+
+    if (size == 0 || bp == 0)
+        return false;
+
+    // BP = 1..6 leave the top 8KB..256KB unprotected
+    if (bp == 7 || (0x1000UL << bp) >= BY25DXX_FLASH_SIZE)
+        hi = BY25DXX_FLASH_SIZE;
+    else
+        hi = BY25DXX_FLASH_SIZE - (0x1000UL << bp);
+
+    return addr < hi;
+#else
+    return false; // unknown device, let the chip decide
+#endif
+}
+
+BY25DXX_ErrorCode BY25DXX_GotoSleep(void)
+{
+    if (WaitBusy() != BY25DXX_ERR_NONE)
+        return BY25DXX_ERR_TIMEOUT;
+
     CS_LOW();
     __spi_send_byte(CMD_GOTO_SLEEP);
     CS_HIGH();
+
+#ifdef BY25DXX_AUTO_SLEEP
+    __sleeping = true;
+    __sleepStart = BY25DXX_GET_TICK();
+    __powerStats.sleepCount++;
+#endif
+
+    return BY25DXX_ERR_NONE;
 }
 
 void BY25DXX_Wakeup(void)
 {
+#ifdef BY25DXX_AUTO_SLEEP
+    PowerActive();
+#else
     CS_LOW();
     __spi_send_byte(CMD_WAKEUP);
     CS_HIGH();
+#endif
+}
+
+#ifdef BY25DXX_AUTO_SLEEP
+
+void BY25DXX_SetIdleTimeout(uint32_t ms)
+{
+    __idleTimeout = ms;
+}
+
+void BY25DXX_PowerPoll(void)
+{
+    if (__sleeping || __idleTimeout == 0)
+        return;
+
+    if (BY25DXX_GET_TICK() - __lastAccess < __idleTimeout)
+        return;
+
+    // don't block here if a program/erase is still running
+    if (ReadStatus(CMD_RD_STATUS) & STATUS_WR_BUSY)
+        return;
+
+    BY25DXX_GotoSleep();
+}
+
+void BY25DXX_GetPowerStats(BY25DXX_PowerStats *stats)
+{
+    *stats = __powerStats;
+
+    if (__sleeping)
+        stats->sleepTime += BY25DXX_GET_TICK() - __sleepStart;
 }
 
-void BY25DXX_GetDeviceInfo(BY25DXX_DeviceInfo *info)
+#endif
+
+BY25DXX_ErrorCode BY25DXX_GetDeviceInfo(BY25DXX_DeviceInfo *info)
 {
-    WaitBusy();
+    if (WaitBusy() != BY25DXX_ERR_NONE)
+        return BY25DXX_ERR_TIMEOUT;
 
     // read device id
     CS_LOW();
@@ -384,4 +1032,29 @@ void BY25DXX_GetDeviceInfo(BY25DXX_DeviceInfo *info)
     info->uniqueID[6] = __spi_send_byte(CMD_NOP);
     info->uniqueID[7] = __spi_send_byte(CMD_NOP);
     CS_HIGH();
+
+    return BY25DXX_ERR_NONE;
 }
+
+#ifdef BY25DXX_TRACE
+
+uint32_t BY25DXX_TraceDump(BY25DXX_TraceRecord *buf, uint32_t max)
+{
+    uint32_t count = __traceCount < BY25DXX_TRACE_SIZE ? __traceCount : BY25DXX_TRACE_SIZE;
+    uint32_t i;
+
+    if (count > max)
+        count = max; // the newest ones
+
+    for (i = 0; i < count; i++)
+        buf[i] = __trace[(__traceCount - count + i) % BY25DXX_TRACE_SIZE];
+
+    return count;
+}
+
+void BY25DXX_TraceClear(void)
+{
+    __traceCount = 0;
+}
+
+#endif
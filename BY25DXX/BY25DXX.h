@@ -20,14 +20,82 @@
 #error "macro 'BY25DXX_WP_HIGH()' and 'BY25DXX_WP_LOW()' must be implemented"
 #endif
 
+/**
+ * automatic deep power-down (optional)
+ * 
+ * define 'BY25DXX_AUTO_SLEEP' to enable, it needs a free running
+ * millisecond counter and a microsecond delay:
+ * 
+ *   #define BY25DXX_GET_TICK() ...
+ *   #define BY25DXX_DELAY_US(us) ...
+*/
+
+#ifdef BY25DXX_AUTO_SLEEP
+#if !defined(BY25DXX_GET_TICK) || !defined(BY25DXX_DELAY_US)
+#error "macro 'BY25DXX_GET_TICK()' and 'BY25DXX_DELAY_US()' must be implemented for 'BY25DXX_AUTO_SLEEP'"
+#endif
+#ifndef BY25DXX_IDLE_TIMEOUT
+#define BY25DXX_IDLE_TIMEOUT 50 // ms
+#endif
+#endif
+
+/**
+ * busy timeout
+ * 
+ * the wait for a program/erase gives up after the datasheet maximum time.
+ * with 'BY25DXX_GET_TICK()' defined the time is measured with it, else the
+ * times requested from the wait hook are summed, so the hook must wait at
+ * least that long, and the spin without a hook counts
+ * 'BY25DXX_SPIN_POLLS_PER_MS' status reads as 1 ms. the default assumes
+ * 0.1 us per status byte, a slower bus waits longer before the timeout.
+*/
+
+#ifndef BY25DXX_POLL_INTERVAL
+#define BY25DXX_POLL_INTERVAL 100 // us, default status poll interval of the wait hook
+#endif
+
+#ifndef BY25DXX_SPIN_POLLS_PER_MS
+#define BY25DXX_SPIN_POLLS_PER_MS 10000
+#endif
+
+#if BY25DXX_POLL_INTERVAL < 1 || BY25DXX_SPIN_POLLS_PER_MS < 1
+#error "'BY25DXX_POLL_INTERVAL' and 'BY25DXX_SPIN_POLLS_PER_MS' must be at least 1"
+#endif
+
+/**
+ * bus trace (optional)
+ * 
+ * define 'BY25DXX_TRACE' to record every transaction into a ring buffer of
+ * 'BY25DXX_TRACE_SIZE' records, it needs a free running counter, us ticks
+ * are best:
+ * 
+ *   #define BY25DXX_TRACE_TICK() ...
+*/
+
+#ifdef BY25DXX_TRACE
+#ifndef BY25DXX_TRACE_TICK
+#error "macro 'BY25DXX_TRACE_TICK()' must be implemented for 'BY25DXX_TRACE'"
+#endif
+#ifndef BY25DXX_TRACE_SIZE
+#define BY25DXX_TRACE_SIZE 128
+#endif
+#endif
+
 //--------------------------------------------------------------
 
 #define BY25DXX_VENDOR_ID 0x68
 
+#define BY25DXX_PAGE_SIZE 256
+#define BY25DXX_SECTOR_SIZE 4096
+#define BY25DXX_HALF_BLOCK_SIZE 32768
+#define BY25DXX_BLOCK_SIZE 65536
+
 #if defined(BY25D20)
 #define BY25DXX_DEV_ID 0x11
+#define BY25DXX_FLASH_SIZE 0x40000UL
 #elif defined(BY25D40)
 #define BY25DXX_DEV_ID 0x12
+#define BY25DXX_FLASH_SIZE 0x80000UL
 #else
 #warning "You should define a BOYA_MICRO SPI Flash device series !"
 #endif
@@ -77,9 +145,36 @@ typedef enum
 typedef enum
 {
     BY25DXX_ERR_NONE = 0,
-    BY25DXX_ERR_FAILED = 1
+    BY25DXX_ERR_FAILED = 1,
+    BY25DXX_ERR_TIMEOUT = 2,
+    BY25DXX_ERR_PROTECTED = 3
 } BY25DXX_ErrorCode;
 
+typedef void (*BY25DXX_WaitHook)(uint32_t us); // sleep or yield for about 'us' microseconds
+
+typedef struct
+{
+    // start a transfer of 'len' bytes (DMA), 'rxBuf' or 'txBuf' is NULL,
+    // a NULL 'txBuf' sends 0x00
+    void (*start)(uint8_t *rxBuf, const uint8_t *txBuf, uint32_t len);
+    void (*wait)(void); // wait until the transfer is done
+} BY25DXX_BulkHook;
+
+typedef struct
+{
+    uint32_t time;     // BY25DXX_TRACE_TICK() at CS low
+    uint32_t cmd;      // opcode << 24 | the 3 bytes after it (address)
+    uint16_t len;      // bytes after the opcode, saturated
+    uint16_t duration; // ticks from CS low to CS high, saturated
+} BY25DXX_TraceRecord;
+
+typedef struct
+{
+    uint32_t busyTime;  // ms spent waiting for program/erase/status write
+    uint32_t sleepTime; // ms spent in deep power-down
+    uint32_t sleepCount;
+} BY25DXX_PowerStats;
+
 /**
  * Init BY25DXX
 */
@@ -91,42 +186,126 @@ BY25DXX_ErrorCode BY25DXX_Init(BY25DXX_SPIHook spiHook);
 
 uint8_t BY25DXX_ReadByte(uint32_t addr);
 uint16_t BY25DXX_ReadWord(uint32_t addr);
-void BY25DXX_ReadBytes(uint32_t addr, uint8_t *buf, uint32_t size);
+BY25DXX_ErrorCode BY25DXX_ReadBytes(uint32_t addr, uint8_t *buf, uint32_t size);
+uint8_t BY25DXX_IsEmpty(uint32_t addr, uint32_t size); // true if every byte of the range is 0xFF, false on a busy timeout
 
 /**
  * write operations
 */
 
-void BY25DXX_WriteByte(uint32_t addr, uint8_t dat);
-void BY25DXX_WriteWord(uint32_t addr, uint16_t word);
-void BY25DXX_WriteBytes(uint32_t addr, uint8_t *buf, uint32_t len);
-void BY25DXX_Erase(uint32_t addr, BY25DXX_EraseType type);
+BY25DXX_ErrorCode BY25DXX_WriteByte(uint32_t addr, uint8_t dat);
+BY25DXX_ErrorCode BY25DXX_WriteWord(uint32_t addr, uint16_t word);
+BY25DXX_ErrorCode BY25DXX_WriteBytes(uint32_t addr, uint8_t *buf, uint32_t len);
+BY25DXX_ErrorCode BY25DXX_ProgramBytes(uint32_t addr, uint8_t *buf, uint32_t len); // no blank check and no erase, target must be erased
+BY25DXX_ErrorCode BY25DXX_Erase(uint32_t addr, BY25DXX_EraseType type);
+BY25DXX_ErrorCode BY25DXX_WaitReady(void); // wait until the running program/erase is done
+
+/**
+ * flash to flash copy
+ * 
+ * the destination is erased in the largest units possible (sectors which
+ * are partly in the range lose the rest, as with 'BY25DXX_WriteBytes()'),
+ * then copied page by page, blank source pages are skipped.
+ * overlapping ranges are copied from the right end. they fail with
+ * BY25DXX_ERR_FAILED, before anything is erased, if a destination sector
+ * holds source data it still needs itself.
+ * 'BY25DXX_MoveRange()' also erases the whole sectors of the source which
+ * are not in the destination
+*/
+
+BY25DXX_ErrorCode BY25DXX_CopyRange(uint32_t src, uint32_t dst, uint32_t len);
+BY25DXX_ErrorCode BY25DXX_MoveRange(uint32_t src, uint32_t dst, uint32_t len);
+
+/**
+ * wait strategy
+ * 
+ * by default the driver polls the status register with CS held low until
+ * a program/erase is done. with a hook installed it calls the hook for the
+ * typical time of the running operation first, then polls every
+ * 'pollInterval' us (0 is taken as 1), and gives up with
+ * BY25DXX_ERR_TIMEOUT after the datasheet maximum time, see "busy timeout".
+ * read functions which can't return an error code give 0xFF on timeout
+*/
+
+void BY25DXX_SetWaitHook(BY25DXX_WaitHook hook, uint32_t pollInterval);
+
+/**
+ * bulk transfer (optional)
+ * 
+ * with a hook installed the data phase of reads and page programs is done
+ * by the hook instead of 'spiHook' byte by byte.
+ * 'BY25DXX_ReadBegin()' starts a read and returns while the transfer runs,
+ * 'BY25DXX_ReadEnd()' waits for it, no other call is allowed in between.
+ * without a hook 'BY25DXX_ReadBegin()' reads the data before it returns
+*/
+
+void BY25DXX_SetBulkHook(const BY25DXX_BulkHook *hook);
+BY25DXX_ErrorCode BY25DXX_ReadBegin(uint32_t addr, uint8_t *buf, uint32_t size);
+void BY25DXX_ReadEnd(void);
 
 /**
  * lock protection bits
 */
 
-void BY25DXX_LockProtectBits(void);
-void BY25DXX_UnlockProtectBits(void);
+BY25DXX_ErrorCode BY25DXX_LockProtectBits(void);
+BY25DXX_ErrorCode BY25DXX_UnlockProtectBits(void);
 
 /**
- * block protection
+ * block protection, counted from the bottom of the chip
+ * 
+ * the driver keeps a copy of the status register, a write which doesn't
+ * change it is skipped.
+ * writes and erases into a protected area fail with BY25DXX_ERR_PROTECTED
+ * before anything is sent
 */
 
 BY25DXX_ProtectSize BY25DXX_GetProtectSize(void);
-void BY25DXX_SetProtectSize(BY25DXX_ProtectSize size);
-void BY25DXX_ClearProtection(void);
+BY25DXX_ErrorCode BY25DXX_SetProtectSize(BY25DXX_ProtectSize size);
+BY25DXX_ErrorCode BY25DXX_ClearProtection(void);
+uint8_t BY25DXX_IsProtected(uint32_t addr, uint32_t size); // true if any byte of the range is protected
 
 /**
  * deep sleep/wakeup
 */
 
-void BY25DXX_GotoSleep(void);
+BY25DXX_ErrorCode BY25DXX_GotoSleep(void);
 void BY25DXX_Wakeup(void);
 
+#ifdef BY25DXX_AUTO_SLEEP
+
+/**
+ * automatic deep power-down
+ * 
+ * the chip is put to sleep by 'BY25DXX_PowerPoll()' once it has been idle for
+ * the timeout (0: never), and woken up on the next access.
+ * call 'BY25DXX_PowerPoll()' periodically from the same context as other calls
+*/
+
+void BY25DXX_SetIdleTimeout(uint32_t ms);
+void BY25DXX_PowerPoll(void);
+void BY25DXX_GetPowerStats(BY25DXX_PowerStats *stats);
+
+#endif
+
+#ifdef BY25DXX_TRACE
+
+/**
+ * bus trace
+ * 
+ * 'BY25DXX_TraceDump()' copies the records oldest first and returns the
+ * count. the host replay tool reads one record per line:
+ * 
+ *   printf("%lu %08lX %u %u\n", time, cmd, len, duration);
+*/
+
+uint32_t BY25DXX_TraceDump(BY25DXX_TraceRecord *buf, uint32_t max);
+void BY25DXX_TraceClear(void);
+
+#endif
+
 /**
  * get device information
 */
-void BY25DXX_GetDeviceInfo(BY25DXX_DeviceInfo *info);
+BY25DXX_ErrorCode BY25DXX_GetDeviceInfo(BY25DXX_DeviceInfo *info);
 
 #endif
@@ -0,0 +1,272 @@
+#include "BY25DXX_bdev.h"
+#include <string.h>
+
+#define PAGE_SIZE BY25DXX_PAGE_SIZE
+#define SECTOR_SIZE BY25DXX_SECTOR_SIZE
+
+#undef true
+#define true 1
+
+#undef false
+#define false 0
+
+#define BLOCK_ADDR(block) (BY25DXX_BD_BASE + (block) * BY25DXX_BD_BLOCK_SIZE)
+
+//------------------- internal func -------------------
+
+static uint8_t IsBlankBuf(const uint8_t *buf, uint32_t size)
+{
+    while (size--)
+    {
+        if (*buf++ != 0xFF)
+            return false;
+    }
+
+    return true;
+}
+
+// program a sector aligned area of an erased sector, blank pages are skipped
+static uint8_t ProgramPages(uint32_t addr, const uint8_t *buf, uint32_t size)
+{
+    uint32_t offset;
+
+    for (offset = 0; offset < size; offset += PAGE_SIZE)
+    {
+        if (IsBlankBuf(buf + offset, PAGE_SIZE))
+            continue;
+
+        if (BY25DXX_ProgramBytes(addr + offset, (uint8_t *)buf + offset, PAGE_SIZE) != BY25DXX_ERR_NONE)
+            return false;
+    }
+
+    return true;
+}
+
+static int ToBdError(BY25DXX_ErrorCode err)
+{
+    switch (err)
+    {
+    case BY25DXX_ERR_NONE:
+        return BY25DXX_BD_ERR_OK;
+    case BY25DXX_ERR_PROTECTED:
+        return BY25DXX_BD_ERR_PROTECTED;
+    case BY25DXX_ERR_FAILED:
+        return BY25DXX_BD_ERR_CORRUPT;
+    default:
+        return BY25DXX_BD_ERR_IO;
+    }
+}
+
+//------------------- littlefs -------------------
+
+int BY25DXX_BD_Read(uint32_t block, uint32_t off, void *buf, uint32_t size)
+{
+    if (block >= BY25DXX_BD_BLOCK_COUNT || off + size > BY25DXX_BD_BLOCK_SIZE)
+        return BY25DXX_BD_ERR_IO;
+
+    if (BY25DXX_ReadBytes(BLOCK_ADDR(block) + off, (uint8_t *)buf, size) != BY25DXX_ERR_NONE)
+        return BY25DXX_BD_ERR_IO;
+
+    return BY25DXX_BD_ERR_OK;
+}
+
+int BY25DXX_BD_Prog(uint32_t block, uint32_t off, const void *buf, uint32_t size)
+{
+    if (block >= BY25DXX_BD_BLOCK_COUNT || off + size > BY25DXX_BD_BLOCK_SIZE)
+        return BY25DXX_BD_ERR_IO;
+
+    return ToBdError(BY25DXX_ProgramBytes(BLOCK_ADDR(block) + off, (uint8_t *)buf, size));
+}
+
+int BY25DXX_BD_Erase(uint32_t block)
+{
+    if (block >= BY25DXX_BD_BLOCK_COUNT)
+        return BY25DXX_BD_ERR_IO;
+
+    return ToBdError(BY25DXX_Erase(BLOCK_ADDR(block), BY25DXX_ERASE_SECTOR));
+}
+
+int BY25DXX_BD_Sync(void)
+{
+    if (BY25DXX_WaitReady() != BY25DXX_ERR_NONE)
+        return BY25DXX_BD_ERR_IO;
+
+    return BY25DXX_BD_ERR_OK;
+}
+
+//------------------- FatFs -------------------
+
+#if BY25DXX_DISK_SECTOR_SIZE < BY25DXX_SECTOR_SIZE
+
+#define CACHE_INVALID 0xFFFFFFFFUL
+
+// write-back buffer of one erase sector
+static uint8_t __disk_cache[SECTOR_SIZE];
+static uint32_t __disk_cache_addr = CACHE_INVALID;
+static uint32_t __disk_cache_dirty; // bitmap of pages which need to be programmed
+static uint8_t __disk_cache_erase;  // some bits must go from 0 to 1, erase on flush
+
+static int FlushCache(void)
+{
+    uint32_t offset;
+
+    if (__disk_cache_addr == CACHE_INVALID || __disk_cache_dirty == 0)
+        return 0;
+
+    if (__disk_cache_erase)
+    {
+        if (BY25DXX_Erase(__disk_cache_addr, BY25DXX_ERASE_SECTOR) != BY25DXX_ERR_NONE)
+            return 1;
+
+        if (ProgramPages(__disk_cache_addr, __disk_cache, SECTOR_SIZE) == false)
+            return 1;
+    }
+    else // only 1 -> 0 changes, program the modified pages in place
+    {
+        for (offset = 0; offset < SECTOR_SIZE; offset += PAGE_SIZE)
+        {
+            if ((__disk_cache_dirty & (1UL << (offset / PAGE_SIZE))) == 0)
+                continue;
+
+            if (BY25DXX_ProgramBytes(__disk_cache_addr + offset, __disk_cache + offset, PAGE_SIZE) != BY25DXX_ERR_NONE)
+                return 1;
+        }
+    }
+
+    __disk_cache_dirty = 0;
+    __disk_cache_erase = false;
+
+    return 0;
+}
+
+static int LoadCache(uint32_t addr)
+{
+    if (__disk_cache_addr == addr)
+        return 0;
+
+    if (FlushCache())
+        return 1;
+
+    if (BY25DXX_ReadBytes(addr, __disk_cache, SECTOR_SIZE) != BY25DXX_ERR_NONE)
+    {
+        __disk_cache_addr = CACHE_INVALID;
+        return 1;
+    }
+
+    __disk_cache_addr = addr;
+
+    return 0;
+}
+
+static void MergeCache(uint32_t offset, const uint8_t *buf, uint32_t size)
+{
+    uint8_t old;
+
+    for (; size--; offset++, buf++)
+    {
+        old = __disk_cache[offset];
+
+        if (old == *buf)
+            continue;
+
+        if ((old & *buf) != *buf)
+            __disk_cache_erase = true;
+
+        __disk_cache[offset] = *buf;
+        __disk_cache_dirty |= 1UL << (offset / PAGE_SIZE);
+    }
+}
+
+#endif
+
+int BY25DXX_Disk_Read(uint8_t *buf, uint32_t sector, uint32_t count)
+{
+    uint32_t addr = BY25DXX_BD_BASE + sector * BY25DXX_DISK_SECTOR_SIZE;
+    uint32_t size = count * BY25DXX_DISK_SECTOR_SIZE;
+#if BY25DXX_DISK_SECTOR_SIZE < BY25DXX_SECTOR_SIZE
+    uint32_t len;
+#endif
+
+    if (sector + count > BY25DXX_DISK_SECTOR_COUNT)
+        return 1;
+
+#if BY25DXX_DISK_SECTOR_SIZE < BY25DXX_SECTOR_SIZE
+    while (size > 0)
+    {
+        len = SECTOR_SIZE - (addr % SECTOR_SIZE);
+        if (len > size)
+            len = size;
+
+        if (addr - (addr % SECTOR_SIZE) == __disk_cache_addr)
+            memcpy(buf, __disk_cache + (addr % SECTOR_SIZE), len);
+        else if (BY25DXX_ReadBytes(addr, buf, len) != BY25DXX_ERR_NONE)
+            return 1;
+
+        buf += len;
+        addr += len;
+        size -= len;
+    }
+#else
+    if (BY25DXX_ReadBytes(addr, buf, size) != BY25DXX_ERR_NONE)
+        return 1;
+#endif
+
+    return 0;
+}
+
+int BY25DXX_Disk_Write(const uint8_t *buf, uint32_t sector, uint32_t count)
+{
+    uint32_t addr = BY25DXX_BD_BASE + sector * BY25DXX_DISK_SECTOR_SIZE;
+    uint32_t size = count * BY25DXX_DISK_SECTOR_SIZE;
+    uint32_t len;
+
+    if (sector + count > BY25DXX_DISK_SECTOR_COUNT)
+        return 1;
+
+    while (size > 0)
+    {
+        len = SECTOR_SIZE - (addr % SECTOR_SIZE);
+        if (len > size)
+            len = size;
+
+        if (len == SECTOR_SIZE) // whole erase sector, bypass the buffer
+        {
+#if BY25DXX_DISK_SECTOR_SIZE < BY25DXX_SECTOR_SIZE
+            if (__disk_cache_addr == addr)
+            {
+                __disk_cache_addr = CACHE_INVALID;
+                __disk_cache_dirty = 0;
+                __disk_cache_erase = false;
+            }
+#endif
+            if (BY25DXX_Erase(addr, BY25DXX_ERASE_SECTOR) != BY25DXX_ERR_NONE ||
+                ProgramPages(addr, buf, SECTOR_SIZE) == false)
+                return 1;
+        }
+#if BY25DXX_DISK_SECTOR_SIZE < BY25DXX_SECTOR_SIZE
+        else
+        {
+            if (LoadCache(addr - (addr % SECTOR_SIZE)))
+                return 1;
+
+            MergeCache(addr % SECTOR_SIZE, buf, len);
+        }
+#endif
+
+        buf += len;
+        addr += len;
+        size -= len;
+    }
+
+    return 0;
+}
+
+int BY25DXX_Disk_Sync(void)
+{
+#if BY25DXX_DISK_SECTOR_SIZE < BY25DXX_SECTOR_SIZE
+    if (FlushCache())
+        return 1;
+#endif
+
+    return BY25DXX_WaitReady() != BY25DXX_ERR_NONE;
+}
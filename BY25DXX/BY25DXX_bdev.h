@@ -0,0 +1,95 @@
+#ifndef _H_BY25DXX_BDEV
+#define _H_BY25DXX_BDEV
+
+#include "BY25DXX.h"
+
+/**
+ * *****************************************************
+ *
+ * block device adapter for file systems
+ *
+ * littlefs ('struct lfs_config'):
+ *   .read_size   = 1
+ *   .prog_size   = BY25DXX_PAGE_SIZE
+ *   .block_size  = BY25DXX_BD_BLOCK_SIZE
+ *   .block_count = BY25DXX_BD_BLOCK_COUNT
+ *   .read/.prog/.erase/.sync forward to BY25DXX_BD_Read/Prog/Erase/Sync
+ *
+ * FatFs ("diskio.c"):
+ *   FF_MIN_SS/FF_MAX_SS = BY25DXX_DISK_SECTOR_SIZE
+ *   disk_read/disk_write forward to BY25DXX_Disk_Read/Write
+ *   CTRL_SYNC        -> BY25DXX_Disk_Sync()
+ *   GET_SECTOR_COUNT -> BY25DXX_DISK_SECTOR_COUNT
+ *   GET_BLOCK_SIZE   -> BY25DXX_DISK_BLOCK_SIZE
+ *
+ * optional settings at "BY25DXX_conf.h":
+ *   BY25DXX_BD_BASE           start address of the region, sector aligned
+ *   BY25DXX_BD_SIZE           size of the region
+ *   BY25DXX_DISK_SECTOR_SIZE  FatFs logical sector size: 512 ~ 4096
+ *
+ * *****************************************************
+*/
+
+#ifndef BY25DXX_FLASH_SIZE
+#error "a BOYA_MICRO SPI Flash device series must be defined to use the block device adapter"
+#endif
+
+#ifndef BY25DXX_BD_BASE
+#define BY25DXX_BD_BASE 0x0UL
+#endif
+
+#ifndef BY25DXX_BD_SIZE
+#define BY25DXX_BD_SIZE (BY25DXX_FLASH_SIZE - BY25DXX_BD_BASE)
+#endif
+
+#if (BY25DXX_BD_BASE % BY25DXX_SECTOR_SIZE) != 0
+#error "'BY25DXX_BD_BASE' must be sector aligned"
+#endif
+
+#define BY25DXX_BD_BLOCK_SIZE BY25DXX_SECTOR_SIZE
+#define BY25DXX_BD_BLOCK_COUNT (BY25DXX_BD_SIZE / BY25DXX_BD_BLOCK_SIZE)
+
+#ifndef BY25DXX_DISK_SECTOR_SIZE
+#define BY25DXX_DISK_SECTOR_SIZE 512
+#endif
+
+#if (BY25DXX_SECTOR_SIZE % BY25DXX_DISK_SECTOR_SIZE) != 0
+#error "'BY25DXX_DISK_SECTOR_SIZE' must divide the erase sector size"
+#endif
+
+#define BY25DXX_DISK_SECTOR_COUNT (BY25DXX_BD_SIZE / BY25DXX_DISK_SECTOR_SIZE)
+#define BY25DXX_DISK_BLOCK_SIZE (BY25DXX_SECTOR_SIZE / BY25DXX_DISK_SECTOR_SIZE) // erase unit in logical sectors
+
+// error codes, same values as littlefs
+#define BY25DXX_BD_ERR_OK 0
+#define BY25DXX_BD_ERR_IO -5         // bus or busy timeout
+#define BY25DXX_BD_ERR_CORRUPT -84   // read back differs from the programmed data
+#define BY25DXX_BD_ERR_PROTECTED -30 // write protected (EROFS), littlefs passes it through
+
+/**
+ * littlefs callbacks
+ *
+ * prog/erase go straight to page program and sector erase, littlefs
+ * manages erases by itself so there is no blank check here
+*/
+
+int BY25DXX_BD_Read(uint32_t block, uint32_t off, void *buf, uint32_t size);
+int BY25DXX_BD_Prog(uint32_t block, uint32_t off, const void *buf, uint32_t size);
+int BY25DXX_BD_Erase(uint32_t block);
+int BY25DXX_BD_Sync(void);
+
+/**
+ * FatFs callbacks, return 0 (RES_OK) or 1 (RES_ERROR)
+ *
+ * logical sectors smaller than the erase sector are merged in a
+ * one-sector write-back buffer, call BY25DXX_Disk_Sync() to flush it.
+ * the buffer takes BY25DXX_SECTOR_SIZE (4 KB) of RAM: a sector which gets a
+ * bit from 0 to 1 is erased, and the rest of it must be kept somewhere.
+ * with BY25DXX_DISK_SECTOR_SIZE = 4096 (FF_MAX_SS = 4096) there is no buffer
+*/
+
+int BY25DXX_Disk_Read(uint8_t *buf, uint32_t sector, uint32_t count);
+int BY25DXX_Disk_Write(const uint8_t *buf, uint32_t sector, uint32_t count);
+int BY25DXX_Disk_Sync(void);
+
+#endif
@@ -0,0 +1,574 @@
+#ifndef _HPP_NORFLASH
+#define _HPP_NORFLASH
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * *****************************************************
+ *
+ * header-only C++ front-end for the W25QXX and BY25DXX parts
+ *
+ * usage:
+ *
+ *   struct MyBus : norflash::ByteBus<MyBus>
+ *   {
+ *       static void select() { ... }   // CS low
+ *       static void deselect() { ... } // CS high
+ *       static uint8_t transfer(uint8_t dat) { ... }
+ *       static void writeProtect(bool on) { ... } // WP low when 'on'
+ *
+ *       // optional, sleep through program/erase instead of polling
+ *       static constexpr bool hasDelay = true;
+ *       static void delayUs(uint32_t us) { ... }
+ *   };
+ *
+ *   typedef norflash::NorFlash<norflash::W25Q64, MyBus> Flash;
+ *   Flash::init();
+ *
+ * the device geometry, IDs, timings and protection table are compile time
+ * constants of the device class, and the bus is a static policy class, so
+ * the read/program loops call the bus directly without a function pointer.
+ * a bus with DMA can replace 'read()'/'write()' of 'ByteBus' with its own
+ * bulk transfer.
+ *
+ * the behaviour follows the C drivers: 'write()' erases the touched
+ * sectors if they aren't blank, 'program()' expects erased flash, waits
+ * are skipped when no program/erase was started, with 'delayUs()' a wait
+ * sleeps the typical time, polls every 'pollInterval' us and gives up with
+ * 'Error::Timeout' after the datasheet maximum. the random read back of
+ * the C 'WritePage()' is not done here.
+ *
+ * needs C++11
+ *
+ * *****************************************************
+*/
+
+namespace norflash
+{
+
+enum class Error : uint8_t
+{
+    None = 0,
+    Failed = 1,
+    Timeout = 2
+};
+
+enum class EraseType : uint8_t
+{
+    Sector = 0x20,    // 4KB
+    HalfBlock = 0x52, // 32KB
+    Block = 0xD8,     // 64KB
+    Chip = 0x60       // ALL
+};
+
+struct DeviceInfo
+{
+    uint8_t vendorID;
+    uint8_t devID;
+    uint8_t memType;
+    uint8_t capacity;
+    uint8_t uniqueID[8];
+};
+
+struct Opcode
+{
+    static constexpr uint8_t NOP = 0x00;
+    static constexpr uint8_t WR_EN = 0x06;
+    static constexpr uint8_t WR_DIS = 0x04;
+    static constexpr uint8_t RD_STATUS = 0x05;
+    static constexpr uint8_t WR_STATUS = 0x01;
+    static constexpr uint8_t RD_STATUS_2 = 0x35;
+    static constexpr uint8_t WR_STATUS_2 = 0x31;
+    static constexpr uint8_t RD_DATA = 0x03;
+    static constexpr uint8_t WR_DATA = 0x02;
+    static constexpr uint8_t GOTO_SLEEP = 0xB9;
+    static constexpr uint8_t WAKEUP = 0xAB;
+    static constexpr uint8_t RD_DEV_ID = 0x90;
+    static constexpr uint8_t RD_JEDEC_ID = 0x9F;
+    static constexpr uint8_t RD_UNIQUE_ID = 0x4B;
+};
+
+struct Status
+{
+    static constexpr uint8_t WR_BUSY = 0x01;
+    static constexpr uint8_t WR_ENABLE = 0x02;
+    static constexpr uint8_t TB_PROTECT = 0x20;
+    static constexpr uint8_t SEC_PROTECT = 0x40;
+    static constexpr uint8_t WR_PROTECT = 0x80;
+    static constexpr uint8_t BP_MASK = 0x1C;
+    static constexpr uint8_t CMP_PROTECT = 0x40; // status register 2
+};
+
+/**
+ * device traits
+ *
+ * time values are typical/maximum in us
+*/
+
+struct Geometry
+{
+    static constexpr uint32_t pageSize = 256;
+    static constexpr uint32_t sectorSize = 4096;
+    static constexpr uint32_t halfBlockSize = 32768;
+    static constexpr uint32_t blockSize = 65536;
+};
+
+// WinBond, BP1 protects 'Unit' bytes at the top, each BP step doubles it
+template <uint8_t DevID, uint32_t Size, uint32_t Unit>
+struct WinBondDevice : Geometry
+{
+    static constexpr uint8_t vendorID = 0xEF;
+    static constexpr uint8_t devID = DevID;
+    static constexpr uint32_t flashSize = Size;
+    static constexpr bool hasStatus2 = true;
+
+    static constexpr uint32_t tPP[2] = {400, 3000};
+    static constexpr uint32_t tSE[2] = {45000, 400000};
+    static constexpr uint32_t tBE32[2] = {120000, 1600000};
+    static constexpr uint32_t tBE64[2] = {150000, 2000000};
+    static constexpr uint32_t tCE[2] = {Size / 0x100000UL * 2500000UL, Size / 0x100000UL * 2500000UL * 5};
+    static constexpr uint32_t tW[2] = {10000, 15000};
+
+    // bytes protected by the BP bits
+    static constexpr uint32_t protectedBytes(uint8_t bp)
+    {
+        return bp == 0 ? 0 : (bp == 7 || (Unit << (bp - 1)) > Size) ? Size : Unit << (bp - 1);
+    }
+};
+
+// Boya, BP1..6 leave 8KB..256KB unprotected at the top
+template <uint8_t DevID, uint32_t Size>
+struct BoyaDevice : Geometry
+{
+    static constexpr uint8_t vendorID = 0x68;
+    static constexpr uint8_t devID = DevID;
+    static constexpr uint32_t flashSize = Size;
+    static constexpr bool hasStatus2 = false;
+
+    static constexpr uint32_t tPP[2] = {600, 2400};
+    static constexpr uint32_t tSE[2] = {60000, 300000};
+    static constexpr uint32_t tBE32[2] = {150000, 1000000};
+    static constexpr uint32_t tBE64[2] = {250000, 1500000};
+    static constexpr uint32_t tCE[2] = {Size / 0x40000UL * 1000000UL, Size / 0x40000UL * 1000000UL * 5};
+    static constexpr uint32_t tW[2] = {5000, 15000};
+
+    static constexpr uint32_t protectedBytes(uint8_t bp)
+    {
+        return bp == 0 ? 0 : (bp == 7 || (0x1000UL << bp) >= Size) ? Size : Size - (0x1000UL << bp);
+    }
+};
+
+template <uint8_t D, uint32_t S, uint32_t U> constexpr uint32_t WinBondDevice<D, S, U>::tPP[2];
+template <uint8_t D, uint32_t S, uint32_t U> constexpr uint32_t WinBondDevice<D, S, U>::tSE[2];
+template <uint8_t D, uint32_t S, uint32_t U> constexpr uint32_t WinBondDevice<D, S, U>::tBE32[2];
+template <uint8_t D, uint32_t S, uint32_t U> constexpr uint32_t WinBondDevice<D, S, U>::tBE64[2];
+template <uint8_t D, uint32_t S, uint32_t U> constexpr uint32_t WinBondDevice<D, S, U>::tCE[2];
+template <uint8_t D, uint32_t S, uint32_t U> constexpr uint32_t WinBondDevice<D, S, U>::tW[2];
+template <uint8_t D, uint32_t S> constexpr uint32_t BoyaDevice<D, S>::tPP[2];
+template <uint8_t D, uint32_t S> constexpr uint32_t BoyaDevice<D, S>::tSE[2];
+template <uint8_t D, uint32_t S> constexpr uint32_t BoyaDevice<D, S>::tBE32[2];
+template <uint8_t D, uint32_t S> constexpr uint32_t BoyaDevice<D, S>::tBE64[2];
+template <uint8_t D, uint32_t S> constexpr uint32_t BoyaDevice<D, S>::tCE[2];
+template <uint8_t D, uint32_t S> constexpr uint32_t BoyaDevice<D, S>::tW[2];
+
+typedef WinBondDevice<0x13, 0x100000UL, 0x10000UL> W25Q80;
+typedef WinBondDevice<0x14, 0x200000UL, 0x10000UL> W25Q16;
+typedef WinBondDevice<0x15, 0x400000UL, 0x10000UL> W25Q32;
+typedef WinBondDevice<0x16, 0x800000UL, 0x20000UL> W25Q64;
+typedef WinBondDevice<0x17, 0x1000000UL, 0x40000UL> W25Q128;
+
+typedef BoyaDevice<0x11, 0x40000UL> BY25D20;
+typedef BoyaDevice<0x12, 0x80000UL> BY25D40;
+
+/**
+ * byte bus helper
+ *
+ * derive the bus from it to get the bulk transfers on top of 'transfer()'
+*/
+
+template <class Impl>
+struct ByteBus
+{
+    static void read(uint8_t *buf, uint32_t len)
+    {
+        while (len--)
+            *buf++ = Impl::transfer(Opcode::NOP);
+    }
+
+    static void write(const uint8_t *buf, uint32_t len)
+    {
+        while (len--)
+            Impl::transfer(*buf++);
+    }
+
+    static void writeProtect(bool on)
+    {
+        (void)on; // WP pin not connected
+    }
+
+    // no delay: poll the status register with CS held low
+    static constexpr bool hasDelay = false;
+    static constexpr uint32_t pollInterval = 100;
+
+    static void delayUs(uint32_t us)
+    {
+        (void)us;
+    }
+};
+
+/**
+ * driver
+*/
+
+template <class Device, class Bus>
+class NorFlash
+{
+public:
+    typedef Device device;
+
+    static Error init()
+    {
+        DeviceInfo info;
+        uint8_t status;
+
+        if (getDeviceInfo(info) != Error::None)
+            return Error::Timeout;
+
+        if (info.vendorID != Device::vendorID || info.devID != Device::devID)
+            return Error::Failed;
+
+        if (!Device::hasStatus2)
+            return Error::None;
+
+        // set SEC, TB bits to 0
+        status = readStatus(Opcode::RD_STATUS);
+        if (writeStatus(Opcode::WR_STATUS, status & 0x1F) != Error::None)
+            return Error::Timeout;
+
+        // set CMP bit to 0
+        status = readStatus(Opcode::RD_STATUS_2);
+        return writeStatus(Opcode::WR_STATUS_2, status & (uint8_t)~Status::CMP_PROTECT);
+    }
+
+    /**
+     * read operations
+    */
+
+    static Error read(uint32_t addr, uint8_t *buf, uint32_t len)
+    {
+        if (waitBusy() != Error::None)
+            return Error::Timeout;
+
+        Bus::select();
+        command(Opcode::RD_DATA, addr);
+        Bus::read(buf, len);
+        Bus::deselect();
+
+        return Error::None;
+    }
+
+    /**
+     * write operations
+    */
+
+    // no blank check and no erase, target must be erased
+    static Error program(uint32_t addr, const uint8_t *buf, uint32_t len)
+    {
+        uint32_t n;
+
+        while (len > 0)
+        {
+            n = Device::pageSize - addr % Device::pageSize;
+            if (n > len)
+                n = len;
+
+            if (waitBusy() != Error::None)
+                return Error::Timeout;
+
+            enableWrite();
+            Bus::select();
+            command(Opcode::WR_DATA, addr);
+            Bus::write(buf, n);
+            Bus::deselect();
+            busy(Device::tPP);
+
+            addr += n;
+            buf += n;
+            len -= n;
+        }
+
+        return Error::None;
+    }
+
+    // erase the touched sectors if they aren't blank, then program
+    static Error write(uint32_t addr, const uint8_t *buf, uint32_t len)
+    {
+        uint32_t chkAddr = addr, chkSize = len, n;
+        Error err;
+
+        while (chkSize > 0)
+        {
+            n = Device::sectorSize - chkAddr % Device::sectorSize;
+            if (n > chkSize)
+                n = chkSize;
+
+            if (!isBlank(chkAddr, n))
+            {
+                err = erase(chkAddr, EraseType::Sector);
+                if (err != Error::None)
+                    return err;
+            }
+
+            chkAddr += n;
+            chkSize -= n;
+        }
+
+        return program(addr, buf, len);
+    }
+
+    static Error erase(uint32_t addr, EraseType type)
+    {
+        if (waitBusy() != Error::None)
+            return Error::Timeout;
+
+        enableWrite();
+        Bus::select();
+        if (type == EraseType::Chip) // chip erase must not be followed by an address
+            Bus::transfer((uint8_t)type);
+        else
+            command((uint8_t)type, addr);
+        Bus::deselect();
+
+        switch (type)
+        {
+        case EraseType::Sector:
+            busy(Device::tSE);
+            break;
+        case EraseType::HalfBlock:
+            busy(Device::tBE32);
+            break;
+        case EraseType::Block:
+            busy(Device::tBE64);
+            break;
+        default:
+            busy(Device::tCE);
+            break;
+        }
+
+        return Error::None;
+    }
+
+    // wait until the running program/erase is done
+    static Error waitReady()
+    {
+        return waitBusy();
+    }
+
+    /**
+     * block protection, 'bp' is the raw BP2..0 value,
+     * 'Device::protectedBytes(bp)' gives its size
+    */
+
+    static uint8_t getProtectBits()
+    {
+        return (readStatus(Opcode::RD_STATUS) & Status::BP_MASK) >> 2;
+    }
+
+    static Error setProtectBits(uint8_t bp)
+    {
+        uint8_t status = readStatus(Opcode::RD_STATUS);
+
+        status &= (uint8_t)~Status::BP_MASK;
+        status |= (bp & 0x07) << 2;
+
+        return writeStatus(Opcode::WR_STATUS, status);
+    }
+
+    static Error lockProtectBits()
+    {
+        if (writeStatus(Opcode::WR_STATUS, readStatus(Opcode::RD_STATUS) | Status::WR_PROTECT) != Error::None)
+            return Error::Timeout;
+
+        Bus::writeProtect(true);
+
+        return Error::None;
+    }
+
+    static Error unlockProtectBits()
+    {
+        Bus::writeProtect(false);
+        return writeStatus(Opcode::WR_STATUS, readStatus(Opcode::RD_STATUS) & (uint8_t)~Status::WR_PROTECT);
+    }
+
+    /**
+     * deep sleep/wakeup
+    */
+
+    static Error gotoSleep()
+    {
+        if (waitBusy() != Error::None)
+            return Error::Timeout;
+
+        Bus::select();
+        Bus::transfer(Opcode::GOTO_SLEEP);
+        Bus::deselect();
+
+        return Error::None;
+    }
+
+    static void wakeup()
+    {
+        Bus::select();
+        Bus::transfer(Opcode::WAKEUP);
+        Bus::deselect();
+    }
+
+    static Error getDeviceInfo(DeviceInfo &info)
+    {
+        if (waitBusy() != Error::None)
+            return Error::Timeout;
+
+        Bus::select();
+        command(Opcode::RD_DEV_ID, 0);
+        info.vendorID = Bus::transfer(Opcode::NOP);
+        info.devID = Bus::transfer(Opcode::NOP);
+        Bus::deselect();
+
+        Bus::select();
+        Bus::transfer(Opcode::RD_JEDEC_ID);
+        Bus::transfer(Opcode::NOP);
+        info.memType = Bus::transfer(Opcode::NOP);
+        info.capacity = Bus::transfer(Opcode::NOP);
+        Bus::deselect();
+
+        Bus::select();
+        command(Opcode::RD_UNIQUE_ID, 0);
+        Bus::transfer(Opcode::NOP); // 4th dummy byte
+        Bus::read(info.uniqueID, sizeof(info.uniqueID));
+        Bus::deselect();
+
+        return Error::None;
+    }
+
+private:
+    // typical/maximum time of the running operation, NULL: idle
+    static const uint32_t *busyTime;
+    static constexpr uint32_t tUnknown[2] = {0, Device::tCE[1]};
+
+    static void busy(const uint32_t (&time)[2])
+    {
+        busyTime = time;
+    }
+
+    static void command(uint8_t cmd, uint32_t addr)
+    {
+        Bus::transfer(cmd);
+        Bus::transfer((uint8_t)(addr >> 16));
+        Bus::transfer((uint8_t)(addr >> 8));
+        Bus::transfer((uint8_t)addr);
+    }
+
+    static void enableWrite()
+    {
+        Bus::select();
+        Bus::transfer(Opcode::WR_EN);
+        Bus::deselect();
+    }
+
+    static uint8_t readStatus(uint8_t cmd)
+    {
+        uint8_t status;
+
+        Bus::select();
+        Bus::transfer(cmd);
+        status = Bus::transfer(Opcode::NOP);
+        Bus::deselect();
+
+        return status;
+    }
+
+    static Error writeStatus(uint8_t cmd, uint8_t dat)
+    {
+        if (waitBusy() != Error::None)
+            return Error::Timeout;
+
+        enableWrite();
+        Bus::select();
+        Bus::transfer(cmd);
+        Bus::transfer(dat);
+        Bus::deselect();
+        busy(Device::tW);
+
+        return Error::None;
+    }
+
+    static Error waitBusy()
+    {
+        uint32_t elapsed;
+
+        if (busyTime == NULL)
+            return Error::None; // nothing has been started since the last wait
+
+        if (!Bus::hasDelay)
+        {
+            Bus::select();
+            Bus::transfer(Opcode::RD_STATUS);
+            while (Bus::transfer(Opcode::NOP) & Status::WR_BUSY)
+                ;
+            Bus::deselect();
+        }
+        else
+        {
+            // sleep through the typical time, then poll with CS released
+            elapsed = busyTime[0];
+            Bus::delayUs(elapsed);
+
+            while (readStatus(Opcode::RD_STATUS) & Status::WR_BUSY)
+            {
+                if (elapsed >= busyTime[1])
+                    return Error::Timeout;
+
+                Bus::delayUs(Bus::pollInterval);
+                elapsed += Bus::pollInterval;
+            }
+        }
+
+        busyTime = NULL;
+
+        return Error::None;
+    }
+
+    static bool isBlank(uint32_t addr, uint32_t len)
+    {
+        if (waitBusy() != Error::None)
+            return false;
+
+        Bus::select();
+        command(Opcode::RD_DATA, addr);
+
+        while (len--)
+        {
+            if (Bus::transfer(Opcode::NOP) != 0xFF)
+            {
+                Bus::deselect();
+                return false;
+            }
+        }
+
+        Bus::deselect();
+
+        return true;
+    }
+};
+
+template <class Device, class Bus>
+constexpr uint32_t NorFlash<Device, Bus>::tUnknown[2];
+
+// the chip may still be busy after an MCU reset
+template <class Device, class Bus>
+const uint32_t *NorFlash<Device, Bus>::busyTime = NorFlash<Device, Bus>::tUnknown;
+
+} // namespace norflash
+
+#endif
@@ -1,7 +1,10 @@
 #include "W25QXX.h"
+#include <stddef.h>
 
-#define PAGE_SIZE 256
-#define SECTOR_SIZE 4096
+#define PAGE_SIZE W25QXX_PAGE_SIZE
+#define SECTOR_SIZE W25QXX_SECTOR_SIZE
+#define SECTOR_FLOOR(addr) ((addr) - (addr) % SECTOR_SIZE)
+#define SECTOR_CEIL(addr) SECTOR_FLOOR((addr) + SECTOR_SIZE - 1)
 
 #undef true
 #define true 1
@@ -24,21 +27,73 @@
 #define CMD_WR_STATUS 0x01
 #define CMD_RD_STATUS_2 0x35
 #define CMD_WR_STATUS_2 0x31
+#define CMD_WR_EN_VOLATILE 0x50
+
+#define STATUS_CMP_PROTECT 0x40 // status register 2
 
 #define CMD_RD_DATA 0x03
 #define CMD_WR_DATA 0x02
 
+#define CMD_DIE_SELECT 0xC2
+
 #define CMD_GOTO_SLEEP 0xB9
 #define CMD_WAKEUP 0xAB
 
+#define TIME_RES1_US 3 // tRES1: release from deep power-down
+
+#ifdef W25QXX_DIE_SIZE
+#define TIME_CE_TYP (W25QXX_DIE_SIZE / 0x100000UL * 2500000UL) // 2.5s per MB, dies erase in parallel
+#else
+#define TIME_CE_TYP 40000000UL
+#endif
+
+// operation the chip may be busy with
+#define OP_NONE 0
+#define OP_PROGRAM 1
+#define OP_ERASE_SECTOR 2
+#define OP_ERASE_HALF_BLOCK 3
+#define OP_ERASE_BLOCK 4
+#define OP_ERASE_CHIP 5
+#define OP_WRITE_STATUS 6
+#define OP_UNKNOWN 7
+
 #define CMD_RD_DEV_ID 0x90
 #define CMD_RD_JEDEC_ID 0x9F
 #define CMD_RD_UNIQUE_ID 0x4B
 
 //---------- internal macro --------------
 
-#define CS_LOW() W25QXX_CS_LOW()
-#define CS_HIGH() W25QXX_CS_HIGH()
+#ifdef W25QXX_TRACE
+#define BUS_LOW()         \
+    do                    \
+    {                     \
+        TraceBegin();     \
+        W25QXX_CS_LOW();  \
+    } while (0)
+#define BUS_HIGH()        \
+    do                    \
+    {                     \
+        W25QXX_CS_HIGH(); \
+        TraceEnd();       \
+    } while (0)
+#define TRACE_BULK(size) TraceBulk(size)
+#else
+#define BUS_LOW() W25QXX_CS_LOW()
+#define BUS_HIGH() W25QXX_CS_HIGH()
+#define TRACE_BULK(size)
+#endif
+
+#ifdef W25QXX_AUTO_SLEEP
+#define CS_LOW()         \
+    do                   \
+    {                    \
+        PowerActive();   \
+        BUS_LOW();       \
+    } while (0)
+#else
+#define CS_LOW() BUS_LOW()
+#endif
+#define CS_HIGH() BUS_HIGH()
 
 #define WP_LOW() W25QXX_WP_LOW()
 #define WP_HIGH() W25QXX_WP_HIGH()
@@ -47,19 +102,149 @@
 
 W25QXX_SPIHook __spi_send_byte;
 
-void EnableWrite()
+#ifdef W25QXX_TRACE
+
+static W25QXX_SPIHook __spi_trace_hook; // the user hook, __spi_send_byte records
+static W25QXX_TraceRecord __trace[W25QXX_TRACE_SIZE];
+static uint32_t __traceCount;
+static uint8_t __traceOpen;
+
+static W25QXX_TraceRecord *TraceCur(void)
+{
+    return &__trace[(__traceCount - 1) % W25QXX_TRACE_SIZE];
+}
+
+static void TraceBegin(void)
+{
+    W25QXX_TraceRecord *rec;
+
+    __traceCount++;
+    rec = TraceCur();
+    rec->time = W25QXX_TRACE_TICK();
+    rec->cmd = 0;
+    rec->len = 0;
+    rec->duration = 0;
+    __traceOpen = 1;
+}
+
+static void TraceEnd(void)
 {
+    W25QXX_TraceRecord *rec = TraceCur();
+    uint32_t duration = W25QXX_TRACE_TICK() - rec->time;
+
+    rec->duration = duration > 0xFFFF ? 0xFFFF : (uint16_t)duration;
+    rec->len = rec->len ? rec->len - 1 : 0; // the opcode isn't counted
+    __traceOpen = 0;
+}
+
+static void TraceBulk(uint32_t size)
+{
+    W25QXX_TraceRecord *rec = TraceCur();
+
+    rec->len = rec->len + size > 0xFFFF ? 0xFFFF : rec->len + size;
+}
+
+static uint8_t TraceXfer(uint8_t dat)
+{
+    W25QXX_TraceRecord *rec = TraceCur();
+
+    if (__traceOpen)
+    {
+        if (rec->len < 4) // opcode and address
+            rec->cmd |= (uint32_t)dat << (24 - rec->len * 8);
+
+        if (rec->len < 0xFFFF)
+            rec->len++;
+    }
+
+    return __spi_trace_hook(dat);
+}
+
+#endif
+
+// typical and maximum busy time of each operation, us
+static const uint32_t __busyTime[][2] = {
+    {0, 0},                           // none
+    {400, 3000},                      // tPP
+    {45000, 400000},                  // tSE
+    {120000, 1600000},                // tBE1
+    {150000, 2000000},                // tBE2
+    {TIME_CE_TYP, TIME_CE_TYP * 5},   // tCE
+    {10000, 15000},                   // tW
+    {0, TIME_CE_TYP * 5},             // unknown
+};
+
+static uint8_t __busyOp[W25QXX_DIE_NUM]; // per die
+static uint8_t __die; // selected die
+static W25QXX_WaitHook __waitHook;
+static uint8_t __status[2];   // copy of SR1 (without BUSY/WEL) and SR2
+static uint8_t __nvStatus[2]; // their non-volatile bits, differ after a volatile write
+static uint8_t __volatileStatus = false;
+static const W25QXX_BulkHook *__bulkHook;
+static uint32_t __pollInterval = W25QXX_POLL_INTERVAL;
+
+#ifdef W25QXX_AUTO_SLEEP
+
+static uint8_t __sleeping = true; // the chip may be left asleep across an MCU reset
+static uint32_t __idleTimeout = W25QXX_IDLE_TIMEOUT;
+static uint32_t __lastAccess;
+static uint32_t __sleepStart;
+static W25QXX_PowerStats __powerStats;
+
+// called before every transaction, wakes the chip up if needed
+static void PowerActive(void)
+{
+    uint32_t now = W25QXX_GET_TICK();
+
+    if (__sleeping)
+    {
+        __sleeping = false;
+        BUS_LOW();
+        __spi_send_byte(CMD_WAKEUP);
+        BUS_HIGH();
+        W25QXX_DELAY_US(TIME_RES1_US);
+        __powerStats.sleepTime += now - __sleepStart;
+    }
+
+    __lastAccess = now;
+}
+
+#endif
+
+#if W25QXX_DIE_NUM > 1
+
+static uint32_t __readAddr; // next address of the open read transaction
+static uint32_t __readLeft; // bytes it can still read in its die
+
+static void SelectDie(uint8_t die)
+{
+    if (die == __die)
+        return;
+
+    // allowed while the other die is busy
     CS_LOW();
-    __spi_send_byte(CMD_WR_EN);
+    __spi_send_byte(CMD_DIE_SELECT);
+    __spi_send_byte(die);
     CS_HIGH();
+    __die = die;
+}
+
+// select the die of 'addr', return the address inside the die
+static uint32_t DieAddr(uint32_t addr)
+{
+    SelectDie((uint8_t)(addr / W25QXX_DIE_SIZE));
+    return addr % W25QXX_DIE_SIZE;
 }
 
-void WaitBusy()
+#else
+#define SelectDie(die)
+#define DieAddr(addr) (addr)
+#endif
+
+void EnableWrite()
 {
     CS_LOW();
-    __spi_send_byte(CMD_RD_STATUS);
-    while ((__spi_send_byte(CMD_NOP) & STATUS_WR_BUSY))
-        ;
+    __spi_send_byte(CMD_WR_EN);
     CS_HIGH();
 }
 
@@ -80,21 +265,146 @@ uint8_t ReadStatus(uint8_t cmd)
     return status;
 }
 
-void WriteStatus(uint8_t cmd, uint8_t dat)
+#ifdef W25QXX_GET_TICK
+// real time, whatever the hook did
+#define ELAPSED_US(start, sum) ((W25QXX_GET_TICK() - (start)) * 1000)
+#else
+// the time requested from the hook, or counted by the spin
+#define ELAPSED_US(start, sum) (sum)
+#endif
+
+W25QXX_ErrorCode WaitBusy()
 {
-    WaitBusy();
-    EnableWrite();
+    W25QXX_ErrorCode err = W25QXX_ERR_NONE;
+    uint32_t maxTime, elapsed = 0, polls = 0;
+#ifdef W25QXX_GET_TICK
+    uint32_t start;
+#endif
+
+    if (__busyOp[__die] == OP_NONE)
+        return W25QXX_ERR_NONE; // nothing has been started since the last wait
+
+    maxTime = __busyTime[__busyOp[__die]][1];
+#ifdef W25QXX_GET_TICK
+    start = W25QXX_GET_TICK();
+#endif
+
+    if (__waitHook == NULL)
+    {
+        // every 'W25QXX_SPIN_POLLS_PER_MS' status reads count as 1 ms
+        CS_LOW();
+        __spi_send_byte(CMD_RD_STATUS);
+        while ((__spi_send_byte(CMD_NOP) & STATUS_WR_BUSY))
+        {
+            if (++polls < W25QXX_SPIN_POLLS_PER_MS)
+                continue;
+
+            polls = 0;
+            elapsed += 1000;
+            if (ELAPSED_US(start, elapsed) > maxTime)
+            {
+                err = W25QXX_ERR_TIMEOUT;
+                break;
+            }
+        }
+        CS_HIGH();
+    }
+    else if (ReadStatus(CMD_RD_STATUS) & STATUS_WR_BUSY)
+    {
+        // not done yet (the CPU or another die may have worked meanwhile),
+        // sleep through the typical time, then poll with CS released
+        elapsed = __busyTime[__busyOp[__die]][0];
+        __waitHook(elapsed);
+
+        while (ReadStatus(CMD_RD_STATUS) & STATUS_WR_BUSY)
+        {
+            if (ELAPSED_US(start, elapsed) > maxTime)
+            {
+                err = W25QXX_ERR_TIMEOUT;
+                break;
+            }
+
+            __waitHook(__pollInterval);
+            elapsed += __pollInterval;
+        }
+    }
+
+#ifdef W25QXX_AUTO_SLEEP
+    __powerStats.busyTime += W25QXX_GET_TICK() - start;
+#endif
+
+    if (err == W25QXX_ERR_NONE)
+        __busyOp[__die] = OP_NONE;
+
+    return err;
+}
+
+static W25QXX_ErrorCode WriteDieStatus(uint8_t cmd, uint8_t dat);
+
+W25QXX_ErrorCode WriteStatus(uint8_t cmd, uint8_t dat)
+{
+    uint8_t reg = cmd == CMD_WR_STATUS_2 ? 1 : 0;
+    uint8_t die;
+
+    if (cmd == CMD_WR_STATUS)
+        dat &= ~(STATUS_WR_BUSY | STATUS_WR_ENABLE);
+
+    // no change, skip the write and its tW. a non-volatile write also
+    // has to match the non-volatile bits, a volatile one may hide them
+    if (dat == __status[reg] && (__volatileStatus || dat == __nvStatus[reg]))
+        return W25QXX_ERR_NONE;
+
+    for (die = 0; die < W25QXX_DIE_NUM; die++)
+    {
+        SelectDie(die);
+        if (WriteDieStatus(cmd, dat) != W25QXX_ERR_NONE)
+            return W25QXX_ERR_TIMEOUT;
+    }
+
+    __status[reg] = dat;
+    if (!__volatileStatus)
+        __nvStatus[reg] = dat;
+
+    return W25QXX_ERR_NONE;
+}
+
+// write a status register of the selected die
+static W25QXX_ErrorCode WriteDieStatus(uint8_t cmd, uint8_t dat)
+{
+    if (WaitBusy() != W25QXX_ERR_NONE)
+        return W25QXX_ERR_TIMEOUT;
+
+    if (__volatileStatus)
+    {
+        CS_LOW();
+        __spi_send_byte(CMD_WR_EN_VOLATILE);
+        CS_HIGH();
+    }
+    else
+    {
+        EnableWrite();
+    }
+
     CS_LOW();
     __spi_send_byte(cmd);
     __spi_send_byte(dat);
     CS_HIGH();
+
+    if (!__volatileStatus)
+        __busyOp[__die] = OP_WRITE_STATUS;
+
+    return W25QXX_ERR_NONE;
 }
 
 uint8_t IsEmptyPage(uint32_t addr)
 {
     uint16_t pageRemain = PAGE_SIZE - (addr % PAGE_SIZE);
 
-    WaitBusy();
+    addr = DieAddr(addr);
+
+    if (WaitBusy() != W25QXX_ERR_NONE)
+        return false;
+
     CS_LOW();
     __spi_send_byte(CMD_RD_DATA);
     SendAddr(addr);
@@ -120,7 +430,11 @@ uint8_t IsEmptySector(uint32_t addr, uint32_t size)
     if (secRemain > size)
         secRemain = size;
 
-    WaitBusy();
+    addr = DieAddr(addr);
+
+    if (WaitBusy() != W25QXX_ERR_NONE)
+        return false;
+
     CS_LOW();
     __spi_send_byte(CMD_RD_DATA);
     SendAddr(addr);
@@ -139,23 +453,118 @@ uint8_t IsEmptySector(uint32_t addr, uint32_t size)
     return true;
 }
 
-uint8_t W25QXX_WritePage(uint32_t addr, uint8_t *buf, uint16_t size)
+// true if erasing [u0, u1) destroys source data not copied yet
+static uint8_t IsCopyConflict(uint32_t u0, uint32_t u1, uint32_t src, uint32_t dst, uint32_t len, uint8_t backward)
 {
-    uint16_t index;
+    uint32_t lo, hi;
+
+    if (backward) // everything below u1 is still to be copied
+    {
+        lo = src;
+        hi = src + ((u1 < dst + len ? u1 : dst + len) - dst);
+    }
+    else // everything above u0
+    {
+        lo = src + ((u0 > dst ? u0 : dst) - dst);
+        hi = src + len;
+    }
 
+    return lo < hi && lo < u1 && u0 < hi;
+}
+
+// largest erase unit at 'pos' (its start, or its end going backward) inside [lo, hi),
+// return 0 if even a sector conflicts with the copy
+static uint32_t NextEraseUnit(uint32_t pos, uint32_t lo, uint32_t hi, uint32_t src, uint32_t dst, uint32_t len, uint8_t backward)
+{
+    static const uint32_t unit[3] = {W25QXX_BLOCK_SIZE, W25QXX_HALF_BLOCK_SIZE, SECTOR_SIZE};
+    uint32_t u0, u1, i;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (pos % unit[i] != 0)
+            continue;
+
+        u0 = backward ? pos - unit[i] : pos;
+        u1 = u0 + unit[i];
+
+        // blocks only where all of it is in the range, sectors may stick out
+        if (i < 2 && (u0 < lo || u1 > hi))
+            continue;
+
+        if (len == 0 || !IsCopyConflict(u0, u1, src, dst, len, backward))
+            return unit[i];
+    }
+
+    return 0;
+}
+
+// erase [addr, addr + size) if any byte of [from, to) in it isn't blank
+static W25QXX_ErrorCode EraseUnit(uint32_t addr, uint32_t size, uint32_t from, uint32_t to)
+{
+    W25QXX_EraseType type = W25QXX_ERASE_SECTOR;
+    uint32_t chk;
+
+    if (from < addr)
+        from = addr;
+    if (to > addr + size)
+        to = addr + size;
+
+    for (chk = from; chk < to; chk += SECTOR_SIZE - chk % SECTOR_SIZE)
+    {
+        if (!IsEmptySector(chk, to - chk))
+            break;
+    }
+
+    if (chk >= to)
+        return W25QXX_ERR_NONE; // blank already
+
+    if (size == W25QXX_BLOCK_SIZE)
+        type = W25QXX_ERASE_BLOCK;
+    else if (size == W25QXX_HALF_BLOCK_SIZE)
+        type = W25QXX_ERASE_HALF_BLOCK;
+
+    return W25QXX_Erase(addr, type);
+}
+
+// copy [from, to) of the destination, page by page
+static W25QXX_ErrorCode CopyPages(uint32_t from, uint32_t to, uint32_t src, uint32_t dst)
+{
+    uint8_t buf[PAGE_SIZE];
+    uint16_t n, i;
+
+    for (; from < to; from += n)
+    {
+        n = PAGE_SIZE - from % PAGE_SIZE;
+        if (n > to - from)
+            n = (uint16_t)(to - from);
+
+        if (W25QXX_ReadBytes(src + (from - dst), buf, n) != W25QXX_ERR_NONE)
+            return W25QXX_ERR_TIMEOUT;
+
+        for (i = 0; i < n && buf[i] == 0xFF; i++)
+            ;
+
+        if (i == n)
+            continue; // blank source page, the destination is erased
+
+        if (W25QXX_ProgramBytes(from, buf, n) == false)
+            return W25QXX_ERR_FAILED;
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+uint8_t W25QXX_WritePage(uint32_t addr, uint8_t *buf, uint16_t size)
+{
 #ifndef W25QXX_WRITE_NO_CHECK
     uint16_t sampleNum = rand() % (size > 4 ? (size >> 2) : size); // sample number: 1/4 data size
-    uint16_t sampleIndex;
+    uint16_t sampleIndex, index;
 #endif
 
-    WaitBusy();
-    EnableWrite();
-    CS_LOW();
-    __spi_send_byte(CMD_WR_DATA);
-    SendAddr(addr);
-    for (index = 0; index < size; index++)
-        __spi_send_byte(buf[index]);
-    CS_HIGH();
+    if (W25QXX_ProgramBegin(addr, buf, size) != W25QXX_ERR_NONE)
+        return false;
+
+    W25QXX_ProgramEnd();
 
 // check data
 #ifndef W25QXX_WRITE_NO_CHECK
@@ -175,11 +584,30 @@ uint8_t W25QXX_WritePage(uint32_t addr, uint8_t *buf, uint16_t size)
 W25QXX_ErrorCode W25QXX_Init(W25QXX_SPIHook spiHook)
 {
     W25QXX_DeviceInfo devInfo;
-    uint8_t status;
+    uint8_t die;
 
+#ifdef W25QXX_TRACE
+    __spi_trace_hook = spiHook;
+    __spi_send_byte = TraceXfer;
+#else
     __spi_send_byte = spiHook;
+#endif
+
+#ifdef W25QXX_AUTO_SLEEP
+    __sleepStart = W25QXX_GET_TICK();
+#endif
 
-    W25QXX_GetDeviceInfo(&devInfo);
+    // the chip may still be busy after an MCU reset
+    for (die = 0; die < W25QXX_DIE_NUM; die++)
+        __busyOp[die] = OP_UNKNOWN;
+
+#if W25QXX_DIE_NUM > 1
+    __die = W25QXX_DIE_NUM; // unknown, the selection survives an MCU reset
+    SelectDie(0);
+#endif
+
+    if (W25QXX_GetDeviceInfo(&devInfo) != W25QXX_ERR_NONE)
+        return W25QXX_ERR_TIMEOUT;
 
 #ifdef W25QXX_DEV_ID
     if (devInfo.vendorID != W25QXX_VENDOR_ID || devInfo.devID != W25QXX_DEV_ID)
@@ -189,21 +617,44 @@ W25QXX_ErrorCode W25QXX_Init(W25QXX_SPIHook spiHook)
         return W25QXX_ERR_FAILED;
 #endif
 
+    __status[0] = ReadStatus(CMD_RD_STATUS) & ~(STATUS_WR_BUSY | STATUS_WR_ENABLE);
+    __status[1] = ReadStatus(CMD_RD_STATUS_2);
+    __nvStatus[0] = __status[0]; // as loaded at power up
+    __nvStatus[1] = __status[1];
+
+#if W25QXX_DIE_NUM > 1
+    // the other dies take the settings of die 0
+    for (die = 1; die < W25QXX_DIE_NUM; die++)
+    {
+        SelectDie(die);
+
+        if ((ReadStatus(CMD_RD_STATUS) & ~(STATUS_WR_BUSY | STATUS_WR_ENABLE)) != __status[0] &&
+            WriteDieStatus(CMD_WR_STATUS, __status[0]) != W25QXX_ERR_NONE)
+            return W25QXX_ERR_TIMEOUT;
+
+        if (ReadStatus(CMD_RD_STATUS_2) != __status[1] &&
+            WriteDieStatus(CMD_WR_STATUS_2, __status[1]) != W25QXX_ERR_NONE)
+            return W25QXX_ERR_TIMEOUT;
+    }
+#endif
+
     // set SEC, TAB bits to 0
-    status = ReadStatus(CMD_RD_STATUS);
-    WriteStatus(CMD_WR_STATUS, status & 0x1F);
+    if (WriteStatus(CMD_WR_STATUS, __status[0] & 0x1F) != W25QXX_ERR_NONE)
+        return W25QXX_ERR_TIMEOUT;
 
     // set CMP bit to 0
-    status = ReadStatus(CMD_RD_STATUS_2);
-    WriteStatus(CMD_WR_STATUS_2, status & 0xBF);
-
-    return W25QXX_ERR_NONE;
+    return WriteStatus(CMD_WR_STATUS_2, __status[1] & 0xBF);
 }
 
 uint8_t W25QXX_ReadByte(uint32_t addr)
 {
     uint8_t dat;
-    WaitBusy();
+
+    addr = DieAddr(addr);
+
+    if (WaitBusy() != W25QXX_ERR_NONE)
+        return 0xFF;
+
     CS_LOW();
     __spi_send_byte(CMD_RD_DATA);
     SendAddr(addr);
@@ -214,16 +665,16 @@ uint8_t W25QXX_ReadByte(uint32_t addr)
 
 uint8_t W25QXX_WriteByte(uint32_t addr, uint8_t dat)
 {
+    if (W25QXX_IsProtected(addr, 1))
+        return false;
+
     if (!IsEmptyPage(addr)) // is not a empty page
         W25QXX_Erase(addr, W25QXX_ERASE_SECTOR);
 
-    WaitBusy();
-    EnableWrite();
-    CS_LOW();
-    __spi_send_byte(CMD_WR_DATA);
-    SendAddr(addr);
-    __spi_send_byte(dat);
-    CS_HIGH();
+    if (W25QXX_ProgramBegin(addr, &dat, 1) != W25QXX_ERR_NONE)
+        return false;
+
+    W25QXX_ProgramEnd();
 
 #ifndef W25QXX_WRITE_NO_CHECK
     return W25QXX_ReadByte(addr) == dat;
@@ -235,7 +686,17 @@ uint8_t W25QXX_WriteByte(uint32_t addr, uint8_t dat)
 uint16_t W25QXX_ReadWord(uint32_t addr)
 {
     uint16_t dat;
-    WaitBusy();
+
+#if W25QXX_DIE_NUM > 1
+    if ((addr + 1) % W25QXX_DIE_SIZE == 0) // the bytes are on two dies
+        return W25QXX_ReadByte(addr) | ((uint16_t)W25QXX_ReadByte(addr + 1) << 8);
+#endif
+
+    addr = DieAddr(addr);
+
+    if (WaitBusy() != W25QXX_ERR_NONE)
+        return 0xFFFF;
+
     CS_LOW();
     __spi_send_byte(CMD_RD_DATA);
     SendAddr(addr);
@@ -253,28 +714,181 @@ uint8_t W25QXX_WriteWord(uint32_t addr, uint16_t word)
     return W25QXX_WriteBytes(addr, buf, 2);
 }
 
-void W25QXX_ReadBytes(uint32_t addr, uint8_t *buf, uint32_t size)
+W25QXX_ErrorCode W25QXX_ReadBytes(uint32_t addr, uint8_t *buf, uint32_t size)
+{
+    if (W25QXX_ReadBegin(addr, buf, size) != W25QXX_ERR_NONE)
+        return W25QXX_ERR_TIMEOUT;
+
+    W25QXX_ReadEnd();
+
+    return W25QXX_ERR_NONE;
+}
+
+uint8_t W25QXX_IsEmpty(uint32_t addr, uint32_t size)
+{
+    uint32_t n;
+
+    while (size > 0)
+    {
+        n = SECTOR_SIZE - addr % SECTOR_SIZE;
+        if (n > size)
+            n = size;
+
+        if (!IsEmptySector(addr, n))
+            return false;
+
+        addr += n;
+        size -= n;
+    }
+
+    return true;
+}
+
+static W25QXX_ErrorCode ReadStart(uint32_t addr, uint8_t *buf, uint32_t size)
 {
-    WaitBusy();
+#if W25QXX_DIE_NUM > 1
+    __readAddr = addr + size;
+    __readLeft = W25QXX_DIE_SIZE - addr % W25QXX_DIE_SIZE - size;
+#endif
+
+    addr = DieAddr(addr);
+
+    if (WaitBusy() != W25QXX_ERR_NONE)
+        return W25QXX_ERR_TIMEOUT;
+
     CS_LOW();
     __spi_send_byte(CMD_RD_DATA);
     SendAddr(addr);
 
+    if (__bulkHook)
+    {
+        TRACE_BULK(size);
+        __bulkHook->start(buf, NULL, size);
+        return W25QXX_ERR_NONE;
+    }
+
     while (size--)
     {
         *buf = __spi_send_byte(CMD_NOP);
         buf++;
     }
 
+    return W25QXX_ERR_NONE;
+}
+
+W25QXX_ErrorCode W25QXX_ReadBegin(uint32_t addr, uint8_t *buf, uint32_t size)
+{
+#if W25QXX_DIE_NUM > 1
+    uint32_t n;
+
+    // a transaction ends with its die, the part in front is read first
+    while (size > W25QXX_DIE_SIZE - addr % W25QXX_DIE_SIZE)
+    {
+        n = W25QXX_DIE_SIZE - addr % W25QXX_DIE_SIZE;
+        if (ReadStart(addr, buf, n) != W25QXX_ERR_NONE)
+            return W25QXX_ERR_TIMEOUT;
+        W25QXX_ReadEnd();
+
+        addr += n;
+        buf += n;
+        size -= n;
+    }
+#endif
+
+    return ReadStart(addr, buf, size);
+}
+
+W25QXX_ErrorCode W25QXX_ReadContinue(uint8_t *buf, uint32_t size)
+{
+#if W25QXX_DIE_NUM > 1
+    uint32_t n = __readLeft;
+
+    if (size > n)
+    {
+        // finish this die, the rest is a new transaction on the next one
+        if (n > 0)
+            W25QXX_ReadContinue(buf, n);
+        W25QXX_ReadEnd();
+        return W25QXX_ReadBegin(__readAddr, buf + n, size - n);
+    }
+
+    __readAddr += size;
+    __readLeft -= size;
+#endif
+
+    // the chip keeps sending the following bytes as long as CS is low
+    if (__bulkHook)
+    {
+        __bulkHook->wait();
+        TRACE_BULK(size);
+        __bulkHook->start(buf, NULL, size);
+        return W25QXX_ERR_NONE;
+    }
+
+    while (size--)
+    {
+        *buf = __spi_send_byte(CMD_NOP);
+        buf++;
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+void W25QXX_ReadEnd(void)
+{
+    if (__bulkHook)
+        __bulkHook->wait();
+
     CS_HIGH();
 }
 
+W25QXX_ErrorCode W25QXX_ProgramBegin(uint32_t addr, uint8_t *buf, uint16_t size)
+{
+    uint16_t index;
+
+    if (W25QXX_IsProtected(addr, size))
+        return W25QXX_ERR_PROTECTED;
+
+    addr = DieAddr(addr);
+
+    if (WaitBusy() != W25QXX_ERR_NONE)
+        return W25QXX_ERR_TIMEOUT;
+
+    EnableWrite();
+    CS_LOW();
+    __spi_send_byte(CMD_WR_DATA);
+    SendAddr(addr);
+
+    if (__bulkHook)
+    {
+        TRACE_BULK(size);
+        __bulkHook->start(NULL, buf, size);
+        return W25QXX_ERR_NONE;
+    }
+
+    for (index = 0; index < size; index++)
+        __spi_send_byte(buf[index]);
+
+    return W25QXX_ERR_NONE;
+}
+
+void W25QXX_ProgramEnd(void)
+{
+    if (__bulkHook)
+        __bulkHook->wait();
+
+    CS_HIGH(); // the chip starts programming here
+    __busyOp[__die] = OP_PROGRAM;
+}
+
 uint8_t W25QXX_WriteBytes(uint32_t addr, uint8_t *buf, uint32_t size)
 {
-    uint16_t pageRemain = PAGE_SIZE - (addr % PAGE_SIZE);
     uint32_t sectorRemain = SECTOR_SIZE - (addr % SECTOR_SIZE);
     uint32_t chkAddr = addr, chkSize = size;
 
+    if (W25QXX_IsProtected(addr, size))
+        return false;
+
     // erase sector
 
     if (chkSize < sectorRemain)
@@ -282,8 +896,9 @@ uint8_t W25QXX_WriteBytes(uint32_t addr, uint8_t *buf, uint32_t size)
 
     while (1)
     {
-        if (!IsEmptySector(chkAddr, sectorRemain))
-            W25QXX_Erase(chkAddr, W25QXX_ERASE_SECTOR);
+        if (!IsEmptySector(chkAddr, sectorRemain) &&
+            W25QXX_Erase(chkAddr, W25QXX_ERASE_SECTOR) != W25QXX_ERR_NONE)
+            return false;
 
         if (chkSize == sectorRemain)
         {
@@ -302,7 +917,15 @@ uint8_t W25QXX_WriteBytes(uint32_t addr, uint8_t *buf, uint32_t size)
         }
     }
 
-    // write data
+    return W25QXX_ProgramBytes(addr, buf, size);
+}
+
+uint8_t W25QXX_ProgramBytes(uint32_t addr, uint8_t *buf, uint32_t size)
+{
+    uint16_t pageRemain = PAGE_SIZE - (addr % PAGE_SIZE);
+
+    if (W25QXX_IsProtected(addr, size))
+        return false;
 
     if (size < pageRemain)
         pageRemain = size;
@@ -333,67 +956,361 @@ uint8_t W25QXX_WriteBytes(uint32_t addr, uint8_t *buf, uint32_t size)
     return true;
 }
 
-void W25QXX_Erase(uint32_t addr, W25QXX_EraseType type)
+// erase on the selected die, 'addr' inside the die
+static W25QXX_ErrorCode EraseDie(uint32_t addr, W25QXX_EraseType type)
 {
-    WaitBusy();
+    if (WaitBusy() != W25QXX_ERR_NONE)
+        return W25QXX_ERR_TIMEOUT;
+
     EnableWrite();
     CS_LOW();
     __spi_send_byte((uint8_t)type);
-    SendAddr(addr);
+    if (type != W25QXX_ERASE_CHIP) // chip erase must not be followed by an address
+        SendAddr(addr);
     CS_HIGH();
+
+    switch (type)
+    {
+    case W25QXX_ERASE_SECTOR:
+        __busyOp[__die] = OP_ERASE_SECTOR;
+        break;
+    case W25QXX_ERASE_HALF_BLOCK:
+        __busyOp[__die] = OP_ERASE_HALF_BLOCK;
+        break;
+    case W25QXX_ERASE_BLOCK:
+        __busyOp[__die] = OP_ERASE_BLOCK;
+        break;
+    default:
+        __busyOp[__die] = OP_ERASE_CHIP;
+        break;
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+W25QXX_ErrorCode W25QXX_Erase(uint32_t addr, W25QXX_EraseType type)
+{
+    uint32_t size;
+    uint8_t die;
+
+    switch (type)
+    {
+    case W25QXX_ERASE_SECTOR:
+        size = SECTOR_SIZE;
+        break;
+    case W25QXX_ERASE_HALF_BLOCK:
+        size = W25QXX_HALF_BLOCK_SIZE;
+        break;
+    case W25QXX_ERASE_BLOCK:
+        size = W25QXX_BLOCK_SIZE;
+        break;
+    default:
+        size = 0; // whole chip, refused by the chip if anything is protected
+        break;
+    }
+
+#ifdef W25QXX_FLASH_SIZE
+    if (size == 0 ? W25QXX_IsProtected(0, W25QXX_FLASH_SIZE) : W25QXX_IsProtected(addr - addr % size, size))
+        return W25QXX_ERR_PROTECTED;
+#endif
+
+    if (type != W25QXX_ERASE_CHIP)
+        return EraseDie(DieAddr(addr), type);
+
+    // every die erases itself, at the same time
+    for (die = 0; die < W25QXX_DIE_NUM; die++)
+    {
+        SelectDie(die);
+        if (EraseDie(0, type) != W25QXX_ERR_NONE)
+            return W25QXX_ERR_TIMEOUT;
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+W25QXX_ErrorCode W25QXX_WaitReady(void)
+{
+    uint8_t die;
+
+    for (die = 0; die < W25QXX_DIE_NUM; die++)
+    {
+        if (__busyOp[die] == OP_NONE)
+            continue;
+
+        SelectDie(die);
+        if (WaitBusy() != W25QXX_ERR_NONE)
+            return W25QXX_ERR_TIMEOUT;
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+W25QXX_ErrorCode W25QXX_CopyRange(uint32_t src, uint32_t dst, uint32_t len)
+{
+    uint8_t backward = dst > src; // copy the end first, its source is below
+    uint32_t lo = SECTOR_FLOOR(dst), hi = SECTOR_CEIL(dst + len);
+    uint32_t pos, addr, size;
+    W25QXX_ErrorCode err;
+
+    if (len == 0 || src == dst)
+        return W25QXX_ERR_NONE;
+
+    if (W25QXX_IsProtected(dst, len))
+        return W25QXX_ERR_PROTECTED;
+
+    // nothing is erased if a sector of the destination holds source data
+    // it still needs itself (overlap closer than a sector)
+    for (pos = lo; pos < hi; pos += SECTOR_SIZE)
+    {
+        if (IsCopyConflict(pos, pos + SECTOR_SIZE, src, dst, len, backward))
+            return W25QXX_ERR_FAILED;
+    }
+
+    pos = backward ? hi : lo;
+
+    while (backward ? pos > lo : pos < hi)
+    {
+        size = NextEraseUnit(pos, dst, dst + len, src, dst, len, backward);
+        addr = backward ? pos - size : pos;
+
+        err = EraseUnit(addr, size, dst, dst + len);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        err = CopyPages(addr > dst ? addr : dst, addr + size < dst + len ? addr + size : dst + len, src, dst);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        pos = backward ? addr : addr + size;
+    }
+
+    return W25QXX_ERR_NONE;
 }
 
-void W25QXX_LockProtectBits(void)
+W25QXX_ErrorCode W25QXX_MoveRange(uint32_t src, uint32_t dst, uint32_t len)
 {
-    WriteStatus(CMD_WR_STATUS, ReadStatus(CMD_RD_STATUS) | 0x80);
+    uint32_t s0 = SECTOR_CEIL(src), s1 = SECTOR_FLOOR(src + len);
+    uint32_t d0 = SECTOR_FLOOR(dst), d1 = SECTOR_CEIL(dst + len);
+    uint32_t range[2][2], pos, size, i;
+    W25QXX_ErrorCode err;
+
+    if (len == 0 || src == dst)
+        return W25QXX_ERR_NONE;
+
+    if (W25QXX_IsProtected(src, len))
+        return W25QXX_ERR_PROTECTED;
+
+    err = W25QXX_CopyRange(src, dst, len);
+    if (err != W25QXX_ERR_NONE)
+        return err;
+
+    // erase the whole sectors of the source outside the destination
+    range[0][0] = s0;
+    range[0][1] = s1 < d0 ? s1 : d0;
+    range[1][0] = s0 > d1 ? s0 : d1;
+    range[1][1] = s1;
+
+    for (i = 0; i < 2; i++)
+    {
+        for (pos = range[i][0]; pos < range[i][1]; pos += size)
+        {
+            size = NextEraseUnit(pos, range[i][0], range[i][1], 0, 0, 0, false);
+
+            err = EraseUnit(pos, size, pos, pos + size);
+            if (err != W25QXX_ERR_NONE)
+                return err;
+        }
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+void W25QXX_SetWaitHook(W25QXX_WaitHook hook, uint32_t pollInterval)
+{
+    __waitHook = hook;
+    __pollInterval = pollInterval > 0 ? pollInterval : 1; // 0 would never time out
+}
+
+void W25QXX_SetBulkHook(const W25QXX_BulkHook *hook)
+{
+    __bulkHook = hook;
+}
+
+const W25QXX_BulkHook *W25QXX_GetBulkHook(void)
+{
+    return __bulkHook;
+}
+
+W25QXX_ErrorCode W25QXX_LockProtectBits(void)
+{
+    if (WriteStatus(CMD_WR_STATUS, __status[0] | STATUS_WR_PROTECT) != W25QXX_ERR_NONE)
+        return W25QXX_ERR_TIMEOUT;
+
     WP_LOW(); // lock
+
+    return W25QXX_ERR_NONE;
 }
 
-void W25QXX_UnlockProtectBits(void)
+W25QXX_ErrorCode W25QXX_UnlockProtectBits(void)
 {
     WP_HIGH(); // Unlock
-    WriteStatus(CMD_WR_STATUS, ReadStatus(CMD_RD_STATUS) | 0x7F);
+    return WriteStatus(CMD_WR_STATUS, __status[0] & ~STATUS_WR_PROTECT);
 }
 
 W25QXX_ProtectSize W25QXX_GetProtectSize(void)
 {
-    return (W25QXX_ProtectSize)GET_PROTECT_BLOCK(ReadStatus(CMD_RD_STATUS));
+    return (W25QXX_ProtectSize)GET_PROTECT_BLOCK(__status[0]);
 }
 
-void W25QXX_SetProtectSize(W25QXX_ProtectSize size)
+W25QXX_ErrorCode W25QXX_SetProtectSize(W25QXX_ProtectSize size)
 {
-    uint8_t status = ReadStatus(CMD_RD_STATUS);
+    uint8_t status = __status[0];
 
     // clear old bits, set new bits
     status &= 0xE3;
     status |= ((size & 0x07) << 2);
 
-    WriteStatus(CMD_WR_STATUS, status);
+    return WriteStatus(CMD_WR_STATUS, status);
 }
 
-void W25QXX_ClearProtection(void)
+W25QXX_ErrorCode W25QXX_ClearProtection(void)
 {
-    W25QXX_SetProtectSize((W25QXX_ProtectSize)0x0);
+    return W25QXX_SetProtectSize((W25QXX_ProtectSize)0x0);
 }
 
-void W25QXX_GotoSleep(void)
+void W25QXX_SetVolatileProtection(uint8_t enable)
 {
-    WaitBusy();
+    __volatileStatus = enable;
+}
+
+// 'addr' inside a die, every die has the same settings
+static uint8_t IsProtectedInDie(uint32_t addr, uint32_t size)
+{
+#ifdef W25QXX_PROTECT_UNIT
+    uint8_t bp = GET_PROTECT_BLOCK(__status[0]);
+    uint32_t lo, hi, protSize;
+
+    if (size == 0)
+        return false;
+
+    if (bp == 0) // nothing protected, everything with CMP = 1
+        return (__status[1] & STATUS_CMP_PROTECT) ? true : false;
+
+    if (bp == 7)
+        protSize = W25QXX_DIE_SIZE;
+    else if (__status[0] & STATUS_SEC_PROTECT)
+        protSize = (0x1000UL << (bp - 1)) > 0x8000UL ? 0x8000UL : (0x1000UL << (bp - 1));
+    else
+        protSize = (W25QXX_PROTECT_UNIT << (bp - 1)) > W25QXX_DIE_SIZE ? W25QXX_DIE_SIZE : (W25QXX_PROTECT_UNIT << (bp - 1));
+
+    // protected area: the top or bottom 'protSize' bytes, the rest with CMP = 1
+    lo = (__status[0] & STATUS_TB_PROTECT) ? 0 : W25QXX_DIE_SIZE - protSize;
+    hi = lo + protSize;
+
+    if (__status[1] & STATUS_CMP_PROTECT)
+        return addr < lo || addr + size > hi;
+
+    return addr < hi && addr + size > lo;
+#else
+    return false; // unknown device, let the chip decide
+#endif
+}
+
+uint8_t W25QXX_IsProtected(uint32_t addr, uint32_t size)
+{
+#ifdef W25QXX_DIE_SIZE
+    uint32_t n;
+
+    while (size > 0)
+    {
+        n = W25QXX_DIE_SIZE - addr % W25QXX_DIE_SIZE;
+        if (n > size)
+            n = size;
+
+        if (IsProtectedInDie(addr % W25QXX_DIE_SIZE, n))
+            return true;
+
+        addr += n;
+        size -= n;
+    }
+
+    return false;
+#else
+    return IsProtectedInDie(addr, size);
+#endif
+}
+
+W25QXX_ErrorCode W25QXX_GotoSleep(void)
+{
+    if (W25QXX_WaitReady() != W25QXX_ERR_NONE)
+        return W25QXX_ERR_TIMEOUT;
+
     CS_LOW();
     __spi_send_byte(CMD_GOTO_SLEEP);
     CS_HIGH();
+
+#ifdef W25QXX_AUTO_SLEEP
+    __sleeping = true;
+    __sleepStart = W25QXX_GET_TICK();
+    __powerStats.sleepCount++;
+#endif
+
+    return W25QXX_ERR_NONE;
 }
 
 void W25QXX_Wakeup(void)
 {
+#ifdef W25QXX_AUTO_SLEEP
+    PowerActive();
+#else
     CS_LOW();
     __spi_send_byte(CMD_WAKEUP);
     CS_HIGH();
+#endif
+}
+
+#ifdef W25QXX_AUTO_SLEEP
+
+void W25QXX_SetIdleTimeout(uint32_t ms)
+{
+    __idleTimeout = ms;
+}
+
+void W25QXX_PowerPoll(void)
+{
+    uint8_t die;
+
+    if (__sleeping || __idleTimeout == 0)
+        return;
+
+    if (W25QXX_GET_TICK() - __lastAccess < __idleTimeout)
+        return;
+
+    // don't block here if a program/erase is still running
+    for (die = 0; die < W25QXX_DIE_NUM; die++)
+    {
+        SelectDie(die);
+        if (ReadStatus(CMD_RD_STATUS) & STATUS_WR_BUSY)
+            return;
+    }
+
+    W25QXX_GotoSleep();
 }
 
-void W25QXX_GetDeviceInfo(W25QXX_DeviceInfo *info)
+void W25QXX_GetPowerStats(W25QXX_PowerStats *stats)
 {
-    WaitBusy();
+    *stats = __powerStats;
+
+    if (__sleeping)
+        stats->sleepTime += W25QXX_GET_TICK() - __sleepStart;
+}
+
+#endif
+
+W25QXX_ErrorCode W25QXX_GetDeviceInfo(W25QXX_DeviceInfo *info)
+{
+    if (WaitBusy() != W25QXX_ERR_NONE)
+        return W25QXX_ERR_TIMEOUT;
 
     // read device id
     CS_LOW();
@@ -429,4 +1346,29 @@ void W25QXX_GetDeviceInfo(W25QXX_DeviceInfo *info)
     info->uniqueID[6] = __spi_send_byte(CMD_NOP);
     info->uniqueID[7] = __spi_send_byte(CMD_NOP);
     CS_HIGH();
+
+    return W25QXX_ERR_NONE;
 }
+
+#ifdef W25QXX_TRACE
+
+uint32_t W25QXX_TraceDump(W25QXX_TraceRecord *buf, uint32_t max)
+{
+    uint32_t count = __traceCount < W25QXX_TRACE_SIZE ? __traceCount : W25QXX_TRACE_SIZE;
+    uint32_t i;
+
+    if (count > max)
+        count = max; // the newest ones
+
+    for (i = 0; i < count; i++)
+        buf[i] = __trace[(__traceCount - count + i) % W25QXX_TRACE_SIZE];
+
+    return count;
+}
+
+void W25QXX_TraceClear(void)
+{
+    __traceCount = 0;
+}
+
+#endif
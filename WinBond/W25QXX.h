@@ -24,24 +24,122 @@
 #error "macro 'W25QXX_WP_HIGH()' and 'W25QXX_WP_LOW()' must be implemented"
 #endif
 
+/**
+ * automatic deep power-down (optional)
+ * 
+ * define 'W25QXX_AUTO_SLEEP' to enable, it needs a free running
+ * millisecond counter and a microsecond delay:
+ * 
+ *   #define W25QXX_GET_TICK() ...
+ *   #define W25QXX_DELAY_US(us) ...
+*/
+
+#ifdef W25QXX_AUTO_SLEEP
+#if !defined(W25QXX_GET_TICK) || !defined(W25QXX_DELAY_US)
+#error "macro 'W25QXX_GET_TICK()' and 'W25QXX_DELAY_US()' must be implemented for 'W25QXX_AUTO_SLEEP'"
+#endif
+#ifndef W25QXX_IDLE_TIMEOUT
+#define W25QXX_IDLE_TIMEOUT 50 // ms
+#endif
+#endif
+
+/**
+ * busy timeout
+ * 
+ * the wait for a program/erase gives up after the datasheet maximum time.
+ * with 'W25QXX_GET_TICK()' defined the time is measured with it, else the
+ * times requested from the wait hook are summed, so the hook must wait at
+ * least that long, and the spin without a hook counts
+ * 'W25QXX_SPIN_POLLS_PER_MS' status reads as 1 ms. the default assumes
+ * 0.1 us per status byte, a slower bus waits longer before the timeout.
+*/
+
+#ifndef W25QXX_POLL_INTERVAL
+#define W25QXX_POLL_INTERVAL 100 // us, default status poll interval of the wait hook
+#endif
+
+#ifndef W25QXX_SPIN_POLLS_PER_MS
+#define W25QXX_SPIN_POLLS_PER_MS 10000
+#endif
+
+#if W25QXX_POLL_INTERVAL < 1 || W25QXX_SPIN_POLLS_PER_MS < 1
+#error "'W25QXX_POLL_INTERVAL' and 'W25QXX_SPIN_POLLS_PER_MS' must be at least 1"
+#endif
+
+/**
+ * bus trace (optional)
+ * 
+ * define 'W25QXX_TRACE' to record every transaction into a ring buffer of
+ * 'W25QXX_TRACE_SIZE' records, it needs a free running counter, us ticks
+ * are best:
+ * 
+ *   #define W25QXX_TRACE_TICK() ...
+*/
+
+#ifdef W25QXX_TRACE
+#ifndef W25QXX_TRACE_TICK
+#error "macro 'W25QXX_TRACE_TICK()' must be implemented for 'W25QXX_TRACE'"
+#endif
+#ifndef W25QXX_TRACE_SIZE
+#define W25QXX_TRACE_SIZE 128
+#endif
+#endif
+
 //--------------------------------------------------------------
 
 #define W25QXX_VENDOR_ID 0xEF
 
+#define W25QXX_PAGE_SIZE 256
+#define W25QXX_SECTOR_SIZE 4096
+#define W25QXX_HALF_BLOCK_SIZE 32768
+#define W25QXX_BLOCK_SIZE 65536
+
 #if defined(W25Q80)
 #define W25QXX_DEV_ID 0x13
+#define W25QXX_DIE_SIZE 0x100000UL
+#define W25QXX_PROTECT_UNIT 0x10000UL // protected by BP = 1
 #elif defined(W25Q16)
 #define W25QXX_DEV_ID 0x14
+#define W25QXX_DIE_SIZE 0x200000UL
+#define W25QXX_PROTECT_UNIT 0x10000UL
 #elif defined(W25Q32)
 #define W25QXX_DEV_ID 0x15
+#define W25QXX_DIE_SIZE 0x400000UL
+#define W25QXX_PROTECT_UNIT 0x10000UL
 #elif defined(W25Q64)
 #define W25QXX_DEV_ID 0x16
+#define W25QXX_DIE_SIZE 0x800000UL
+#define W25QXX_PROTECT_UNIT 0x20000UL
 #elif defined(W25Q128)
 #define W25QXX_DEV_ID 0x17
+#define W25QXX_DIE_SIZE 0x1000000UL
+#define W25QXX_PROTECT_UNIT 0x40000UL
 #else
 #warning "You should define a WinBond SPI Flash device series !"
 #endif
 
+/**
+ * stacked dies (optional)
+ * 
+ * for W25M parts with several dies behind one CS define 'W25QXX_DIE_NUM'
+ * and the series of one die. the dies are one linear address space, the
+ * driver selects the die of each access (Software Die Select, 0xC2) and
+ * keeps the busy state of every die, so an erase or program on one die
+ * doesn't block an access to another. the protection settings are the
+ * same on all dies, each die protects its own part of the space.
+ * a read transaction ('W25QXX_ReadBegin()') is split at die boundaries
+*/
+
+#ifndef W25QXX_DIE_NUM
+#define W25QXX_DIE_NUM 1
+#endif
+
+#ifdef W25QXX_DIE_SIZE
+#define W25QXX_FLASH_SIZE (W25QXX_DIE_SIZE * W25QXX_DIE_NUM) // all dies
+#elif W25QXX_DIE_NUM > 1
+#error "'W25QXX_DIE_NUM' needs a WinBond SPI Flash device series"
+#endif
+
 //--------------------------------------------------------------
 
 typedef uint8_t (*W25QXX_SPIHook)(uint8_t);
@@ -109,9 +207,36 @@ typedef enum
 typedef enum
 {
     W25QXX_ERR_NONE = 0,
-    W25QXX_ERR_FAILED = 1
+    W25QXX_ERR_FAILED = 1,
+    W25QXX_ERR_TIMEOUT = 2,
+    W25QXX_ERR_PROTECTED = 3
 } W25QXX_ErrorCode;
 
+typedef void (*W25QXX_WaitHook)(uint32_t us); // sleep or yield for about 'us' microseconds
+
+typedef struct
+{
+    // start a transfer of 'len' bytes (DMA), 'rxBuf' or 'txBuf' is NULL,
+    // a NULL 'txBuf' sends 0x00
+    void (*start)(uint8_t *rxBuf, const uint8_t *txBuf, uint32_t len);
+    void (*wait)(void); // wait until the transfer is done
+} W25QXX_BulkHook;
+
+typedef struct
+{
+    uint32_t time;     // W25QXX_TRACE_TICK() at CS low
+    uint32_t cmd;      // opcode << 24 | the 3 bytes after it (address)
+    uint16_t len;      // bytes after the opcode, saturated
+    uint16_t duration; // ticks from CS low to CS high, saturated
+} W25QXX_TraceRecord;
+
+typedef struct
+{
+    uint32_t busyTime;  // ms spent waiting for program/erase/status write
+    uint32_t sleepTime; // ms spent in deep power-down
+    uint32_t sleepCount;
+} W25QXX_PowerStats;
+
 /**
  * Init W25QXX
 */
@@ -123,7 +248,8 @@ W25QXX_ErrorCode W25QXX_Init(W25QXX_SPIHook spiHook);
 
 uint8_t W25QXX_ReadByte(uint32_t addr);
 uint16_t W25QXX_ReadWord(uint32_t addr);
-void W25QXX_ReadBytes(uint32_t addr, uint8_t *buf, uint32_t size);
+W25QXX_ErrorCode W25QXX_ReadBytes(uint32_t addr, uint8_t *buf, uint32_t size);
+uint8_t W25QXX_IsEmpty(uint32_t addr, uint32_t size); // true if every byte of the range is 0xFF, false on a busy timeout
 
 /**
  * write operations
@@ -132,33 +258,127 @@ void W25QXX_ReadBytes(uint32_t addr, uint8_t *buf, uint32_t size);
 uint8_t W25QXX_WriteByte(uint32_t addr, uint8_t dat);
 uint8_t W25QXX_WriteWord(uint32_t addr, uint16_t word);
 uint8_t W25QXX_WriteBytes(uint32_t addr, uint8_t *buf, uint32_t len);
-void W25QXX_Erase(uint32_t addr, W25QXX_EraseType type);
+uint8_t W25QXX_ProgramBytes(uint32_t addr, uint8_t *buf, uint32_t len); // no blank check and no erase, target must be erased
+W25QXX_ErrorCode W25QXX_Erase(uint32_t addr, W25QXX_EraseType type);
+W25QXX_ErrorCode W25QXX_WaitReady(void); // wait until the running program/erase is done, on all dies
+
+/**
+ * flash to flash copy
+ * 
+ * the destination is erased in the largest units possible (sectors which
+ * are partly in the range lose the rest, as with 'W25QXX_WriteBytes()'),
+ * then copied page by page, blank source pages are skipped.
+ * overlapping ranges are copied from the right end. they fail with
+ * W25QXX_ERR_FAILED, before anything is erased, if a destination sector
+ * holds source data it still needs itself.
+ * 'W25QXX_MoveRange()' also erases the whole sectors of the source which
+ * are not in the destination
+*/
+
+W25QXX_ErrorCode W25QXX_CopyRange(uint32_t src, uint32_t dst, uint32_t len);
+W25QXX_ErrorCode W25QXX_MoveRange(uint32_t src, uint32_t dst, uint32_t len);
+
+/**
+ * wait strategy
+ * 
+ * by default the driver polls the status register with CS held low until
+ * a program/erase is done. with a hook installed it reads the status once,
+ * if the operation is still running it calls the hook for the typical
+ * time of the operation, then polls every
+ * 'pollInterval' us (0 is taken as 1), and gives up with
+ * W25QXX_ERR_TIMEOUT after the datasheet maximum time, see "busy timeout".
+ * read functions which can't return an error code give 0xFF on timeout
+*/
+
+void W25QXX_SetWaitHook(W25QXX_WaitHook hook, uint32_t pollInterval);
+
+/**
+ * bulk transfer (optional)
+ * 
+ * with a hook installed the data phase of reads and page programs is done
+ * by the hook instead of 'spiHook' byte by byte.
+ * 'W25QXX_ReadBegin()' starts a read and returns while the transfer runs,
+ * 'W25QXX_ReadEnd()' waits for it, no other call is allowed in between.
+ * without a hook 'W25QXX_ReadBegin()' reads the data before it returns.
+ * 'W25QXX_ProgramBegin()'/'W25QXX_ProgramEnd()' do the same for a page
+ * program, the program time starts at 'W25QXX_ProgramEnd()'
+*/
+
+void W25QXX_SetBulkHook(const W25QXX_BulkHook *hook);
+const W25QXX_BulkHook *W25QXX_GetBulkHook(void); // NULL without a hook
+W25QXX_ErrorCode W25QXX_ReadBegin(uint32_t addr, uint8_t *buf, uint32_t size);
+W25QXX_ErrorCode W25QXX_ReadContinue(uint8_t *buf, uint32_t size); // wait, then read the next bytes in the same transaction
+void W25QXX_ReadEnd(void);
+W25QXX_ErrorCode W25QXX_ProgramBegin(uint32_t addr, uint8_t *buf, uint16_t size); // one page at most, target must be erased
+void W25QXX_ProgramEnd(void);
 
 /**
  * lock protection bits
 */
 
-void W25QXX_LockProtectBits(void);
-void W25QXX_UnlockProtectBits(void);
+W25QXX_ErrorCode W25QXX_LockProtectBits(void);
+W25QXX_ErrorCode W25QXX_UnlockProtectBits(void);
 
 /**
  * block protection
+ * 
+ * the driver keeps a copy of the status registers and of their stored
+ * bits, a write which changes neither is skipped. with
+ * 'W25QXX_SetVolatileProtection(true)' the changes go to the volatile
+ * status registers: no tW wait, the chip loads the stored protection
+ * again at power up.
+ * writes and erases into a protected area fail with W25QXX_ERR_PROTECTED
+ * (or false) before anything is sent
 */
 
 W25QXX_ProtectSize W25QXX_GetProtectSize(void);
-void W25QXX_SetProtectSize(W25QXX_ProtectSize size);
-void W25QXX_ClearProtection(void);
+W25QXX_ErrorCode W25QXX_SetProtectSize(W25QXX_ProtectSize size);
+W25QXX_ErrorCode W25QXX_ClearProtection(void);
+void W25QXX_SetVolatileProtection(uint8_t enable);
+uint8_t W25QXX_IsProtected(uint32_t addr, uint32_t size); // true if any byte of the range is protected
 
 /**
  * deep sleep/wakeup
 */
 
-void W25QXX_GotoSleep(void);
+W25QXX_ErrorCode W25QXX_GotoSleep(void);
 void W25QXX_Wakeup(void);
 
+#ifdef W25QXX_AUTO_SLEEP
+
+/**
+ * automatic deep power-down
+ * 
+ * the chip is put to sleep by 'W25QXX_PowerPoll()' once it has been idle for
+ * the timeout (0: never), and woken up on the next access.
+ * call 'W25QXX_PowerPoll()' periodically from the same context as other calls
+*/
+
+void W25QXX_SetIdleTimeout(uint32_t ms);
+void W25QXX_PowerPoll(void);
+void W25QXX_GetPowerStats(W25QXX_PowerStats *stats);
+
+#endif
+
+#ifdef W25QXX_TRACE
+
+/**
+ * bus trace
+ * 
+ * 'W25QXX_TraceDump()' copies the records oldest first and returns the
+ * count. the host replay tool reads one record per line:
+ * 
+ *   printf("%lu %08lX %u %u\n", time, cmd, len, duration);
+*/
+
+uint32_t W25QXX_TraceDump(W25QXX_TraceRecord *buf, uint32_t max);
+void W25QXX_TraceClear(void);
+
+#endif
+
 /**
  * get device information
 */
-void W25QXX_GetDeviceInfo(W25QXX_DeviceInfo *info);
+W25QXX_ErrorCode W25QXX_GetDeviceInfo(W25QXX_DeviceInfo *info);
 
 #endif
@@ -0,0 +1,282 @@
+#include "W25QXX_bdev.h"
+#include <string.h>
+
+#define PAGE_SIZE W25QXX_PAGE_SIZE
+#define SECTOR_SIZE W25QXX_SECTOR_SIZE
+
+#undef true
+#define true 1
+
+#undef false
+#define false 0
+
+#define BLOCK_ADDR(block) (W25QXX_BD_BASE + (block) * W25QXX_BD_BLOCK_SIZE)
+
+//------------------- internal func -------------------
+
+static uint8_t IsBlankBuf(const uint8_t *buf, uint32_t size)
+{
+    while (size--)
+    {
+        if (*buf++ != 0xFF)
+            return false;
+    }
+
+    return true;
+}
+
+// program a sector aligned area of an erased sector, blank pages are skipped
+static uint8_t ProgramPages(uint32_t addr, const uint8_t *buf, uint32_t size)
+{
+    uint32_t offset;
+
+    for (offset = 0; offset < size; offset += PAGE_SIZE)
+    {
+        if (IsBlankBuf(buf + offset, PAGE_SIZE))
+            continue;
+
+        if (W25QXX_ProgramBytes(addr + offset, (uint8_t *)buf + offset, PAGE_SIZE) == false)
+            return false;
+    }
+
+    return true;
+}
+
+static int ToBdError(W25QXX_ErrorCode err)
+{
+    switch (err)
+    {
+    case W25QXX_ERR_NONE:
+        return W25QXX_BD_ERR_OK;
+    case W25QXX_ERR_PROTECTED:
+        return W25QXX_BD_ERR_PROTECTED;
+    case W25QXX_ERR_FAILED:
+        return W25QXX_BD_ERR_CORRUPT;
+    default:
+        return W25QXX_BD_ERR_IO;
+    }
+}
+
+//------------------- littlefs -------------------
+
+int W25QXX_BD_Read(uint32_t block, uint32_t off, void *buf, uint32_t size)
+{
+    if (block >= W25QXX_BD_BLOCK_COUNT || off + size > W25QXX_BD_BLOCK_SIZE)
+        return W25QXX_BD_ERR_IO;
+
+    if (W25QXX_ReadBytes(BLOCK_ADDR(block) + off, (uint8_t *)buf, size) != W25QXX_ERR_NONE)
+        return W25QXX_BD_ERR_IO;
+
+    return W25QXX_BD_ERR_OK;
+}
+
+int W25QXX_BD_Prog(uint32_t block, uint32_t off, const void *buf, uint32_t size)
+{
+    if (block >= W25QXX_BD_BLOCK_COUNT || off + size > W25QXX_BD_BLOCK_SIZE)
+        return W25QXX_BD_ERR_IO;
+
+    if (W25QXX_IsProtected(BLOCK_ADDR(block) + off, size))
+        return W25QXX_BD_ERR_PROTECTED;
+
+    if (W25QXX_WaitReady() != W25QXX_ERR_NONE)
+        return W25QXX_BD_ERR_IO;
+
+    // the program fails on a busy timeout or when the read back differs
+    if (W25QXX_ProgramBytes(BLOCK_ADDR(block) + off, (uint8_t *)buf, size) == false)
+        return W25QXX_WaitReady() != W25QXX_ERR_NONE ? W25QXX_BD_ERR_IO : W25QXX_BD_ERR_CORRUPT;
+
+    return W25QXX_BD_ERR_OK;
+}
+
+int W25QXX_BD_Erase(uint32_t block)
+{
+    if (block >= W25QXX_BD_BLOCK_COUNT)
+        return W25QXX_BD_ERR_IO;
+
+    return ToBdError(W25QXX_Erase(BLOCK_ADDR(block), W25QXX_ERASE_SECTOR));
+}
+
+int W25QXX_BD_Sync(void)
+{
+    if (W25QXX_WaitReady() != W25QXX_ERR_NONE)
+        return W25QXX_BD_ERR_IO;
+
+    return W25QXX_BD_ERR_OK;
+}
+
+//------------------- FatFs -------------------
+
+#if W25QXX_DISK_SECTOR_SIZE < W25QXX_SECTOR_SIZE
+
+#define CACHE_INVALID 0xFFFFFFFFUL
+
+// write-back buffer of one erase sector
+static uint8_t __disk_cache[SECTOR_SIZE];
+static uint32_t __disk_cache_addr = CACHE_INVALID;
+static uint32_t __disk_cache_dirty; // bitmap of pages which need to be programmed
+static uint8_t __disk_cache_erase;  // some bits must go from 0 to 1, erase on flush
+
+static int FlushCache(void)
+{
+    uint32_t offset;
+
+    if (__disk_cache_addr == CACHE_INVALID || __disk_cache_dirty == 0)
+        return 0;
+
+    if (__disk_cache_erase)
+    {
+        if (W25QXX_Erase(__disk_cache_addr, W25QXX_ERASE_SECTOR) != W25QXX_ERR_NONE)
+            return 1;
+
+        if (ProgramPages(__disk_cache_addr, __disk_cache, SECTOR_SIZE) == false)
+            return 1;
+    }
+    else // only 1 -> 0 changes, program the modified pages in place
+    {
+        for (offset = 0; offset < SECTOR_SIZE; offset += PAGE_SIZE)
+        {
+            if ((__disk_cache_dirty & (1UL << (offset / PAGE_SIZE))) == 0)
+                continue;
+
+            if (W25QXX_ProgramBytes(__disk_cache_addr + offset, __disk_cache + offset, PAGE_SIZE) == false)
+                return 1;
+        }
+    }
+
+    __disk_cache_dirty = 0;
+    __disk_cache_erase = false;
+
+    return 0;
+}
+
+static int LoadCache(uint32_t addr)
+{
+    if (__disk_cache_addr == addr)
+        return 0;
+
+    if (FlushCache())
+        return 1;
+
+    if (W25QXX_ReadBytes(addr, __disk_cache, SECTOR_SIZE) != W25QXX_ERR_NONE)
+    {
+        __disk_cache_addr = CACHE_INVALID;
+        return 1;
+    }
+
+    __disk_cache_addr = addr;
+
+    return 0;
+}
+
+static void MergeCache(uint32_t offset, const uint8_t *buf, uint32_t size)
+{
+    uint8_t old;
+
+    for (; size--; offset++, buf++)
+    {
+        old = __disk_cache[offset];
+
+        if (old == *buf)
+            continue;
+
+        if ((old & *buf) != *buf)
+            __disk_cache_erase = true;
+
+        __disk_cache[offset] = *buf;
+        __disk_cache_dirty |= 1UL << (offset / PAGE_SIZE);
+    }
+}
+
+#endif
+
+int W25QXX_Disk_Read(uint8_t *buf, uint32_t sector, uint32_t count)
+{
+    uint32_t addr = W25QXX_BD_BASE + sector * W25QXX_DISK_SECTOR_SIZE;
+    uint32_t size = count * W25QXX_DISK_SECTOR_SIZE;
+#if W25QXX_DISK_SECTOR_SIZE < W25QXX_SECTOR_SIZE
+    uint32_t len;
+#endif
+
+    if (sector + count > W25QXX_DISK_SECTOR_COUNT)
+        return 1;
+
+#if W25QXX_DISK_SECTOR_SIZE < W25QXX_SECTOR_SIZE
+    while (size > 0)
+    {
+        len = SECTOR_SIZE - (addr % SECTOR_SIZE);
+        if (len > size)
+            len = size;
+
+        if (addr - (addr % SECTOR_SIZE) == __disk_cache_addr)
+            memcpy(buf, __disk_cache + (addr % SECTOR_SIZE), len);
+        else if (W25QXX_ReadBytes(addr, buf, len) != W25QXX_ERR_NONE)
+            return 1;
+
+        buf += len;
+        addr += len;
+        size -= len;
+    }
+#else
+    if (W25QXX_ReadBytes(addr, buf, size) != W25QXX_ERR_NONE)
+        return 1;
+#endif
+
+    return 0;
+}
+
+int W25QXX_Disk_Write(const uint8_t *buf, uint32_t sector, uint32_t count)
+{
+    uint32_t addr = W25QXX_BD_BASE + sector * W25QXX_DISK_SECTOR_SIZE;
+    uint32_t size = count * W25QXX_DISK_SECTOR_SIZE;
+    uint32_t len;
+
+    if (sector + count > W25QXX_DISK_SECTOR_COUNT)
+        return 1;
+
+    while (size > 0)
+    {
+        len = SECTOR_SIZE - (addr % SECTOR_SIZE);
+        if (len > size)
+            len = size;
+
+        if (len == SECTOR_SIZE) // whole erase sector, bypass the buffer
+        {
+#if W25QXX_DISK_SECTOR_SIZE < W25QXX_SECTOR_SIZE
+            if (__disk_cache_addr == addr)
+            {
+                __disk_cache_addr = CACHE_INVALID;
+                __disk_cache_dirty = 0;
+                __disk_cache_erase = false;
+            }
+#endif
+            if (W25QXX_Erase(addr, W25QXX_ERASE_SECTOR) != W25QXX_ERR_NONE ||
+                ProgramPages(addr, buf, SECTOR_SIZE) == false)
+                return 1;
+        }
+#if W25QXX_DISK_SECTOR_SIZE < W25QXX_SECTOR_SIZE
+        else
+        {
+            if (LoadCache(addr - (addr % SECTOR_SIZE)))
+                return 1;
+
+            MergeCache(addr % SECTOR_SIZE, buf, len);
+        }
+#endif
+
+        buf += len;
+        addr += len;
+        size -= len;
+    }
+
+    return 0;
+}
+
+int W25QXX_Disk_Sync(void)
+{
+#if W25QXX_DISK_SECTOR_SIZE < W25QXX_SECTOR_SIZE
+    if (FlushCache())
+        return 1;
+#endif
+
+    return W25QXX_WaitReady() != W25QXX_ERR_NONE;
+}
@@ -0,0 +1,95 @@
+#ifndef _H_W25QXX_BDEV
+#define _H_W25QXX_BDEV
+
+#include "W25QXX.h"
+
+/**
+ * *****************************************************
+ *
+ * block device adapter for file systems
+ *
+ * littlefs ('struct lfs_config'):
+ *   .read_size   = 1
+ *   .prog_size   = W25QXX_PAGE_SIZE
+ *   .block_size  = W25QXX_BD_BLOCK_SIZE
+ *   .block_count = W25QXX_BD_BLOCK_COUNT
+ *   .read/.prog/.erase/.sync forward to W25QXX_BD_Read/Prog/Erase/Sync
+ *
+ * FatFs ("diskio.c"):
+ *   FF_MIN_SS/FF_MAX_SS = W25QXX_DISK_SECTOR_SIZE
+ *   disk_read/disk_write forward to W25QXX_Disk_Read/Write
+ *   CTRL_SYNC        -> W25QXX_Disk_Sync()
+ *   GET_SECTOR_COUNT -> W25QXX_DISK_SECTOR_COUNT
+ *   GET_BLOCK_SIZE   -> W25QXX_DISK_BLOCK_SIZE
+ *
+ * optional settings at "W25QXX_conf.h":
+ *   W25QXX_BD_BASE           start address of the region, sector aligned
+ *   W25QXX_BD_SIZE           size of the region
+ *   W25QXX_DISK_SECTOR_SIZE  FatFs logical sector size: 512 ~ 4096
+ *
+ * *****************************************************
+*/
+
+#ifndef W25QXX_FLASH_SIZE
+#error "a WinBond SPI Flash device series must be defined to use the block device adapter"
+#endif
+
+#ifndef W25QXX_BD_BASE
+#define W25QXX_BD_BASE 0x0UL
+#endif
+
+#ifndef W25QXX_BD_SIZE
+#define W25QXX_BD_SIZE (W25QXX_FLASH_SIZE - W25QXX_BD_BASE)
+#endif
+
+#if (W25QXX_BD_BASE % W25QXX_SECTOR_SIZE) != 0
+#error "'W25QXX_BD_BASE' must be sector aligned"
+#endif
+
+#define W25QXX_BD_BLOCK_SIZE W25QXX_SECTOR_SIZE
+#define W25QXX_BD_BLOCK_COUNT (W25QXX_BD_SIZE / W25QXX_BD_BLOCK_SIZE)
+
+#ifndef W25QXX_DISK_SECTOR_SIZE
+#define W25QXX_DISK_SECTOR_SIZE 512
+#endif
+
+#if (W25QXX_SECTOR_SIZE % W25QXX_DISK_SECTOR_SIZE) != 0
+#error "'W25QXX_DISK_SECTOR_SIZE' must divide the erase sector size"
+#endif
+
+#define W25QXX_DISK_SECTOR_COUNT (W25QXX_BD_SIZE / W25QXX_DISK_SECTOR_SIZE)
+#define W25QXX_DISK_BLOCK_SIZE (W25QXX_SECTOR_SIZE / W25QXX_DISK_SECTOR_SIZE) // erase unit in logical sectors
+
+// error codes, same values as littlefs
+#define W25QXX_BD_ERR_OK 0
+#define W25QXX_BD_ERR_IO -5         // bus or busy timeout
+#define W25QXX_BD_ERR_CORRUPT -84   // read back differs from the programmed data
+#define W25QXX_BD_ERR_PROTECTED -30 // write protected (EROFS), littlefs passes it through
+
+/**
+ * littlefs callbacks
+ *
+ * prog/erase go straight to page program and sector erase, littlefs
+ * manages erases by itself so there is no blank check here
+*/
+
+int W25QXX_BD_Read(uint32_t block, uint32_t off, void *buf, uint32_t size);
+int W25QXX_BD_Prog(uint32_t block, uint32_t off, const void *buf, uint32_t size);
+int W25QXX_BD_Erase(uint32_t block);
+int W25QXX_BD_Sync(void);
+
+/**
+ * FatFs callbacks, return 0 (RES_OK) or 1 (RES_ERROR)
+ *
+ * logical sectors smaller than the erase sector are merged in a
+ * one-sector write-back buffer, call W25QXX_Disk_Sync() to flush it.
+ * the buffer takes W25QXX_SECTOR_SIZE (4 KB) of RAM: a sector which gets a
+ * bit from 0 to 1 is erased, and the rest of it must be kept somewhere.
+ * with W25QXX_DISK_SECTOR_SIZE = 4096 (FF_MAX_SS = 4096) there is no buffer
+*/
+
+int W25QXX_Disk_Read(uint8_t *buf, uint32_t sector, uint32_t count);
+int W25QXX_Disk_Write(const uint8_t *buf, uint32_t sector, uint32_t count);
+int W25QXX_Disk_Sync(void);
+
+#endif
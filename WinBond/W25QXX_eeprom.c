@@ -0,0 +1,240 @@
+#include "W25QXX_eeprom.h"
+#include "W25QXX_sum.h"
+
+#define PAGE_SIZE W25QXX_PAGE_SIZE
+#define SECTOR_SIZE W25QXX_SECTOR_SIZE
+
+#undef true
+#define true 1
+
+#undef false
+#define false 0
+
+#define RECORD_NUM (SECTOR_SIZE / sizeof(Record))
+#define PAGE_RECORDS (PAGE_SIZE / sizeof(Record))
+#define HEADER_CELL 0xFFFE // record 0 of a sector, 'value' is its sequence number
+#define ERASED_VALUE ((W25QXX_EE_Value)0xFFFFFFFFUL)
+#define SLOT_INVALID 0 // 'W25QXX_EE_Init()' not called yet, slot 0 is the header
+
+// one update, 'check' is a CRC16 of 'cell' and 'value'
+typedef struct
+{
+    uint16_t cell;
+    uint16_t check;
+    uint32_t value;
+} Record;
+
+//------------------- internal func -------------------
+
+static W25QXX_EE_Value __table[W25QXX_EE_CELLS];
+static uint8_t __active;                // index of the active sector
+static uint32_t __seq;                  // sequence number of the active sector
+static uint16_t __slot = SLOT_INVALID; // next free record of the active sector
+
+// CRC16 of 'cell' and 'value', little endian
+static uint16_t RecordCheck(uint16_t cell, uint32_t value)
+{
+    uint8_t buf[6];
+
+    buf[0] = (uint8_t)cell;
+    buf[1] = (uint8_t)(cell >> 8);
+    buf[2] = (uint8_t)value;
+    buf[3] = (uint8_t)(value >> 8);
+    buf[4] = (uint8_t)(value >> 16);
+    buf[5] = (uint8_t)(value >> 24);
+
+    return W25QXX_SUM_Crc16(0xFFFF, buf, sizeof(buf));
+}
+
+static void MakeRecord(Record *rec, uint16_t cell, uint32_t value)
+{
+    rec->cell = cell;
+    rec->value = value;
+    rec->check = RecordCheck(cell, value);
+}
+
+static uint8_t IsBlankRecord(const Record *rec)
+{
+    return rec->cell == 0xFFFF && rec->check == 0xFFFF && rec->value == 0xFFFFFFFFUL;
+}
+
+static uint8_t IsValidRecord(const Record *rec)
+{
+    return rec->check == RecordCheck(rec->cell, rec->value);
+}
+
+static uint32_t SectorAddr(uint8_t index)
+{
+    return W25QXX_EE_ADDR + (uint32_t)index * SECTOR_SIZE;
+}
+
+static W25QXX_ErrorCode ProgramRecords(uint32_t addr, Record *rec, uint16_t num)
+{
+    return W25QXX_ProgramBytes(addr, (uint8_t *)rec, num * sizeof(Record)) ? W25QXX_ERR_NONE : W25QXX_ERR_FAILED;
+}
+
+// copy the live cells into the next sector and make it the active one
+static W25QXX_ErrorCode Compact(void)
+{
+    Record page[PAGE_RECORDS];
+    W25QXX_ErrorCode err;
+    uint8_t target = (__active + 1) % W25QXX_EE_SECTORS;
+    uint16_t cell, slot = 1, first = 1;
+
+    err = W25QXX_Erase(SectorAddr(target), W25QXX_ERASE_SECTOR);
+    if (err != W25QXX_ERR_NONE)
+        return err;
+
+    // cells which read as erased need no record, the rest is packed page by page
+    for (cell = 0; cell < W25QXX_EE_CELLS; cell++)
+    {
+        if (__table[cell] == ERASED_VALUE)
+            continue;
+
+        MakeRecord(&page[slot % PAGE_RECORDS], cell, __table[cell]);
+        slot++;
+
+        if (slot % PAGE_RECORDS == 0)
+        {
+            err = ProgramRecords(SectorAddr(target) + first * sizeof(Record), &page[first % PAGE_RECORDS], slot - first);
+            if (err != W25QXX_ERR_NONE)
+                return err;
+            first = slot;
+        }
+    }
+
+    if (slot > first)
+    {
+        err = ProgramRecords(SectorAddr(target) + first * sizeof(Record), &page[first % PAGE_RECORDS], slot - first);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+    }
+
+    // the header goes last, until then the old sector stays active
+    MakeRecord(&page[0], HEADER_CELL, __seq + 1);
+    err = ProgramRecords(SectorAddr(target), &page[0], 1);
+    if (err != W25QXX_ERR_NONE)
+        return err;
+
+    __active = target;
+    __seq++;
+    __slot = slot;
+
+    return W25QXX_ERR_NONE;
+}
+
+// fill the table from the records of the active sector
+static W25QXX_ErrorCode Load(void)
+{
+    Record page[PAGE_RECORDS];
+    W25QXX_ErrorCode err;
+    uint16_t slot;
+
+    for (slot = 1; slot < RECORD_NUM; slot++)
+    {
+        if (slot == 1 || slot % PAGE_RECORDS == 0)
+        {
+            err = W25QXX_ReadBytes(SectorAddr(__active) + (slot - slot % PAGE_RECORDS) * sizeof(Record),
+                                   (uint8_t *)page, PAGE_SIZE);
+            if (err != W25QXX_ERR_NONE)
+                return err;
+        }
+
+        // records are appended, the first blank one is the end
+        if (IsBlankRecord(&page[slot % PAGE_RECORDS]))
+            break;
+
+        // a torn record fails the check and is skipped
+        if (IsValidRecord(&page[slot % PAGE_RECORDS]) && page[slot % PAGE_RECORDS].cell < W25QXX_EE_CELLS)
+            __table[page[slot % PAGE_RECORDS].cell] = (W25QXX_EE_Value)page[slot % PAGE_RECORDS].value;
+    }
+
+    __slot = slot;
+
+    return W25QXX_ERR_NONE;
+}
+
+//-----------------------------------------------
+
+W25QXX_ErrorCode W25QXX_EE_Init(void)
+{
+    W25QXX_ErrorCode err;
+    Record header;
+    uint8_t index, found = false;
+    uint16_t cell;
+
+    for (cell = 0; cell < W25QXX_EE_CELLS; cell++)
+        __table[cell] = ERASED_VALUE;
+
+    // the valid header with the newest sequence number marks the active sector
+    for (index = 0; index < W25QXX_EE_SECTORS; index++)
+    {
+        err = W25QXX_ReadBytes(SectorAddr(index), (uint8_t *)&header, sizeof(header));
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        if (header.cell != HEADER_CELL || IsValidRecord(&header) == false)
+            continue;
+
+        if (found == false || (int32_t)(header.value - __seq) > 0)
+        {
+            __active = index;
+            __seq = header.value;
+            found = true;
+        }
+    }
+
+    if (found)
+        return Load();
+
+    // nothing valid, start with sector 0 and all cells erased
+    __active = W25QXX_EE_SECTORS - 1;
+    __seq = 0xFFFFFFFFUL;
+
+    err = Compact();
+    if (err != W25QXX_ERR_NONE)
+        __slot = SLOT_INVALID;
+
+    return err;
+}
+
+W25QXX_EE_Value W25QXX_EE_Read(uint16_t cell)
+{
+    if (cell >= W25QXX_EE_CELLS)
+        return ERASED_VALUE;
+
+    return __table[cell];
+}
+
+W25QXX_ErrorCode W25QXX_EE_Write(uint16_t cell, W25QXX_EE_Value value)
+{
+    W25QXX_ErrorCode err;
+    W25QXX_EE_Value old;
+    Record rec;
+
+    if (__slot == SLOT_INVALID || cell >= W25QXX_EE_CELLS)
+        return W25QXX_ERR_FAILED;
+
+    if (__table[cell] == value)
+        return W25QXX_ERR_NONE;
+
+    old = __table[cell];
+    __table[cell] = value;
+
+    if (__slot >= RECORD_NUM)
+    {
+        // the new value goes into the compacted sector with the others
+        err = Compact();
+    }
+    else
+    {
+        MakeRecord(&rec, cell, value);
+        err = ProgramRecords(SectorAddr(__active) + __slot * sizeof(Record), &rec, 1);
+        __slot++; // a failed record is skipped, it may be half programmed
+    }
+
+    if (err != W25QXX_ERR_NONE)
+        __table[cell] = old;
+
+    return err;
+}
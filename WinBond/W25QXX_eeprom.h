@@ -0,0 +1,88 @@
+#ifndef _H_W25QXX_EEPROM
+#define _H_W25QXX_EEPROM
+
+#include "W25QXX.h"
+
+/**
+ * *****************************************************
+ *
+ * EEPROM emulation
+ *
+ * a fixed set of cells, addressed 0 .. W25QXX_EE_CELLS - 1, which can be
+ * rewritten one by one. 'W25QXX_WriteByte()' on a used location erases the
+ * whole sector, here an update only appends an (index, value) record to
+ * the active sector, one 8 byte program.
+ *
+ * the values are kept in a RAM table which 'W25QXX_EE_Init()' builds from
+ * the records, reads don't touch the flash. when the active sector is full
+ * the live cells are compacted into the next one of the rotating sectors,
+ * so an erase is needed only every (records per sector - cells) updates.
+ *
+ * a new sector becomes active when its header is written, after the cells
+ * are copied. an update or a compaction cut by power loss leaves the old
+ * value. cells never written read as all ones, like erased EEPROM.
+ * records are checked with 'W25QXX_SUM_Crc16()', link "W25QXX_sum.c".
+ *
+ * settings at "W25QXX_conf.h":
+ *   W25QXX_EE_ADDR     address of the reserved sectors, sector aligned
+ *   W25QXX_EE_SECTORS  number of rotating sectors, default 2
+ *   W25QXX_EE_CELLS    number of cells, less than 511
+ *   W25QXX_EE_CELL_32  define for 32 bit cells, 16 bit by default
+ *
+ *   W25QXX_EE_Init();
+ *   W25QXX_EE_Write(CFG_VOLUME, 7);
+ *   volume = W25QXX_EE_Read(CFG_VOLUME);
+ *
+ * *****************************************************
+*/
+
+#ifndef W25QXX_EE_ADDR
+#error "macro 'W25QXX_EE_ADDR' must be defined"
+#endif
+
+#ifndef W25QXX_EE_CELLS
+#error "macro 'W25QXX_EE_CELLS' must be defined"
+#endif
+
+#ifndef W25QXX_EE_SECTORS
+#define W25QXX_EE_SECTORS 2
+#endif
+
+#if (W25QXX_EE_ADDR % W25QXX_SECTOR_SIZE) != 0
+#error "'W25QXX_EE_ADDR' must be sector aligned"
+#endif
+
+#if W25QXX_EE_SECTORS < 2
+#error "'W25QXX_EE_SECTORS' must be 2 at least"
+#endif
+
+// one record is the header, the cells must leave room for updates
+#if W25QXX_EE_CELLS >= (W25QXX_SECTOR_SIZE / 8 - 1)
+#error "too many cells for one sector"
+#endif
+
+#ifdef W25QXX_EE_CELL_32
+typedef uint32_t W25QXX_EE_Value;
+#else
+typedef uint16_t W25QXX_EE_Value;
+#endif
+
+#define W25QXX_EE_AREA_SIZE (W25QXX_EE_SECTORS * W25QXX_SECTOR_SIZE)
+
+/**
+ * call once after 'W25QXX_Init()', loads the cells,
+ * formats the sectors if none is valid
+*/
+W25QXX_ErrorCode W25QXX_EE_Init(void);
+
+/**
+ * an index out of range reads as all ones
+*/
+W25QXX_EE_Value W25QXX_EE_Read(uint16_t cell);
+
+/**
+ * writing the value a cell already has costs nothing
+*/
+W25QXX_ErrorCode W25QXX_EE_Write(uint16_t cell, W25QXX_EE_Value value);
+
+#endif
@@ -0,0 +1,615 @@
+#include "W25QXX_lz.h"
+#include "W25QXX_sum.h"
+#include <string.h>
+
+#define SECTOR_SIZE W25QXX_SECTOR_SIZE
+#define CHUNK_SIZE W25QXX_LZ_CHUNK_SIZE
+
+#undef true
+#define true 1
+
+#undef false
+#define false 0
+
+// sector header: u32 seq, u32 first chunk, u16 offset of the first chunk, u16 check
+#define SECTOR_HEADER_SIZE 12
+
+// chunk header: stored size (bit 15: not compressed), raw size, check, commit
+#define CHUNK_HEADER_SIZE 8
+#define STORED_RAW 0x8000
+#define STORED_SIZE(v) ((v) & 0x7FFF)
+
+// chunk header state
+#define CHUNK_BLANK 0
+#define CHUNK_TORN 1 // cut while programming the header, no data follows
+#define CHUNK_OPEN 2 // cut before the commit, data is incomplete
+#define CHUNK_DONE 3
+
+// LZ4 block format limits
+#define MIN_MATCH 4
+#define LAST_LITERALS 5
+#define MF_LIMIT 12
+#define HASH_SIZE (1 << W25QXX_LZ_HASH_LOG)
+
+//------------------- internal func -------------------
+
+static uint16_t __hash[HASH_SIZE];
+static uint8_t __packed[CHUNK_SIZE];
+
+static uint32_t Read32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t Hash(uint32_t seq)
+{
+    return (uint16_t)((uint32_t)(seq * 2654435761UL) >> (32 - W25QXX_LZ_HASH_LOG));
+}
+
+static uint16_t PutLength(uint8_t *dst, uint16_t len)
+{
+    uint16_t n = 0;
+
+    while (len >= 255)
+    {
+        dst[n++] = 255;
+        len -= 255;
+    }
+
+    dst[n++] = (uint8_t)len;
+
+    return n;
+}
+
+// return compressed size, 0 if the result isn't smaller than 'cap'
+static uint16_t Compress(const uint8_t *src, uint16_t size, uint8_t *dst, uint16_t cap)
+{
+    uint16_t ip = 0, anchor = 0, op = 0;
+    uint16_t ref, litLen, matchLen;
+    uint32_t seq;
+    uint8_t *token;
+
+    memset(__hash, 0, sizeof(__hash));
+
+    while (size > MF_LIMIT && ip < size - MF_LIMIT)
+    {
+        seq = Read32(src + ip);
+        ref = __hash[Hash(seq)];
+        __hash[Hash(seq)] = ip;
+
+        if (ref >= ip || Read32(src + ref) != seq)
+        {
+            ip++;
+            continue;
+        }
+
+        matchLen = MIN_MATCH;
+        while (ip + matchLen < size - LAST_LITERALS && src[ref + matchLen] == src[ip + matchLen])
+            matchLen++;
+
+        litLen = ip - anchor;
+
+        // worst case size of this sequence
+        if (op + 1 + litLen / 255 + 1 + litLen + 2 + (matchLen - MIN_MATCH) / 255 + 1 >= cap)
+            return 0;
+
+        token = dst + op++;
+        *token = (uint8_t)((litLen < 15 ? litLen : 15) << 4);
+        if (litLen >= 15)
+            op += PutLength(dst + op, litLen - 15);
+
+        memcpy(dst + op, src + anchor, litLen);
+        op += litLen;
+
+        dst[op++] = (uint8_t)(ip - ref);
+        dst[op++] = (uint8_t)((ip - ref) >> 8);
+
+        *token |= (uint8_t)(matchLen - MIN_MATCH < 15 ? matchLen - MIN_MATCH : 15);
+        if (matchLen - MIN_MATCH >= 15)
+            op += PutLength(dst + op, matchLen - MIN_MATCH - 15);
+
+        ip += matchLen;
+        anchor = ip;
+    }
+
+    // last literals
+    litLen = size - anchor;
+
+    if (op + 1 + litLen / 255 + 1 + litLen >= cap)
+        return 0;
+
+    dst[op++] = (uint8_t)((litLen < 15 ? litLen : 15) << 4);
+    if (litLen >= 15)
+        op += PutLength(dst + op, litLen - 15);
+
+    memcpy(dst + op, src + anchor, litLen);
+    op += litLen;
+
+    return op;
+}
+
+static uint8_t GetLength(const uint8_t *src, uint16_t size, uint16_t *ip, uint16_t *len)
+{
+    uint8_t b;
+
+    do
+    {
+        if (*ip >= size)
+            return false;
+        b = src[(*ip)++];
+        *len += b;
+    } while (b == 255);
+
+    return true;
+}
+
+// return decompressed size, 0 if the data is malformed
+static uint16_t Decompress(const uint8_t *src, uint16_t size, uint8_t *dst, uint16_t cap)
+{
+    uint16_t ip = 0, op = 0;
+    uint16_t len, offset;
+    uint8_t token;
+
+    while (ip < size)
+    {
+        token = src[ip++];
+
+        len = token >> 4;
+        if (len == 15 && !GetLength(src, size, &ip, &len))
+            return 0;
+
+        if (len > size - ip || len > cap - op)
+            return 0;
+
+        memcpy(dst + op, src + ip, len);
+        ip += len;
+        op += len;
+
+        if (ip == size)
+            break; // last sequence has no match
+
+        if (size - ip < 2)
+            return 0;
+
+        offset = src[ip] | ((uint16_t)src[ip + 1] << 8);
+        ip += 2;
+
+        if (offset == 0 || offset > op)
+            return 0;
+
+        len = token & 0x0F;
+        if (len == 15 && !GetLength(src, size, &ip, &len))
+            return 0;
+        len += MIN_MATCH;
+
+        if (len > cap - op)
+            return 0;
+
+        // may overlap, copy byte by byte
+        for (; len; len--, op++)
+            dst[op] = dst[op - offset];
+    }
+
+    return op;
+}
+
+typedef struct
+{
+    uint32_t seq;
+    uint32_t chunk;
+    uint16_t first; // 0: not a valid header
+} SectorHeader;
+
+typedef struct
+{
+    uint16_t stored;
+    uint16_t raw;
+    uint8_t state;
+} ChunkHeader;
+
+static void Write16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void Write32(uint8_t *p, uint32_t v)
+{
+    Write16(p, (uint16_t)v);
+    Write16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t Read16(const uint8_t *p)
+{
+    return p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t SectorAddr(W25QXX_LZ_Stream *s, uint32_t sector)
+{
+    return s->base + sector * SECTOR_SIZE;
+}
+
+static uint32_t NextSector(W25QXX_LZ_Stream *s, uint32_t sector)
+{
+    return sector + 1 < s->sectors ? sector + 1 : 0;
+}
+
+static uint8_t ReadSectorHeader(W25QXX_LZ_Stream *s, uint32_t sector, SectorHeader *h)
+{
+    uint8_t header[SECTOR_HEADER_SIZE];
+
+    if (W25QXX_ReadBytes(SectorAddr(s, sector), header, SECTOR_HEADER_SIZE) != W25QXX_ERR_NONE)
+        return false;
+
+    h->seq = Read32(header);
+    h->chunk = Read32(header + 4);
+    h->first = Read16(header + 8);
+
+    if (Read16(header + 10) != W25QXX_SUM_Crc16(0xFFFF, header, 10) ||
+        h->first < SECTOR_HEADER_SIZE || h->first > SECTOR_SIZE)
+        h->first = 0;
+
+    return true;
+}
+
+static uint8_t ReadChunkHeader(W25QXX_LZ_Stream *s, uint32_t sector, uint32_t offset, ChunkHeader *h)
+{
+    uint8_t header[CHUNK_HEADER_SIZE];
+    uint8_t i;
+
+    if (W25QXX_ReadBytes(SectorAddr(s, sector) + offset, header, CHUNK_HEADER_SIZE) != W25QXX_ERR_NONE)
+        return false;
+
+    h->stored = Read16(header);
+    h->raw = Read16(header + 2);
+    h->state = CHUNK_BLANK;
+
+    for (i = 0; i < CHUNK_HEADER_SIZE; i++)
+    {
+        if (header[i] != 0xFF)
+            h->state = CHUNK_TORN;
+    }
+
+    if (h->state == CHUNK_TORN && Read16(header + 4) == W25QXX_SUM_Crc16(0xFFFF, header, 4) &&
+        h->raw != 0 && h->raw <= CHUNK_SIZE && STORED_SIZE(h->stored) <= CHUNK_SIZE)
+        h->state = Read16(header + 6) == 0 ? CHUNK_DONE : CHUNK_OPEN;
+
+    return true;
+}
+
+// the data of a chunk continues behind the header of the next sector
+static uint8_t ProgramSpan(W25QXX_LZ_Stream *s, uint32_t sector, uint32_t offset, uint8_t *buf, uint16_t len)
+{
+    uint16_t n = SECTOR_SIZE - offset < len ? (uint16_t)(SECTOR_SIZE - offset) : len;
+
+    if (n > 0 && W25QXX_ProgramBytes(SectorAddr(s, sector) + offset, buf, n) == false)
+        return false;
+
+    if (len > n)
+        return W25QXX_ProgramBytes(SectorAddr(s, NextSector(s, sector)) + SECTOR_HEADER_SIZE, buf + n, len - n);
+
+    return true;
+}
+
+static uint8_t ReadSpan(W25QXX_LZ_Stream *s, uint32_t sector, uint32_t offset, uint8_t *buf, uint16_t len)
+{
+    uint16_t n = SECTOR_SIZE - offset < len ? (uint16_t)(SECTOR_SIZE - offset) : len;
+
+    if (n > 0 && W25QXX_ReadBytes(SectorAddr(s, sector) + offset, buf, n) != W25QXX_ERR_NONE)
+        return false;
+
+    if (len > n)
+        return W25QXX_ReadBytes(SectorAddr(s, NextSector(s, sector)) + SECTOR_HEADER_SIZE, buf + n, len - n) == W25QXX_ERR_NONE;
+
+    return true;
+}
+
+// erase a sector and make it the head, 'chunk' starts at 'first' in it
+static uint8_t StartSector(W25QXX_LZ_Stream *s, uint32_t sector, uint32_t seq, uint32_t chunk, uint16_t first)
+{
+    uint8_t header[SECTOR_HEADER_SIZE];
+
+    if (W25QXX_Erase(SectorAddr(s, sector), W25QXX_ERASE_SECTOR) != W25QXX_ERR_NONE)
+        return false;
+
+    Write32(header, seq);
+    Write32(header + 4, chunk);
+    Write16(header + 8, first);
+    Write16(header + 10, W25QXX_SUM_Crc16(0xFFFF, header, 10));
+
+    if (W25QXX_ProgramBytes(SectorAddr(s, sector), header, SECTOR_HEADER_SIZE) == false)
+        return false;
+
+    s->head = sector;
+    s->seq = seq;
+    s->index[sector] = chunk;
+
+    return true;
+}
+
+// move on to the next sector, it's the oldest one when the region is full
+static uint8_t NextHead(W25QXX_LZ_Stream *s, uint32_t chunk, uint16_t first)
+{
+    uint32_t sector = NextSector(s, s->head);
+
+    if (sector == s->oldest) // recycle it, the chunks starting in it are dropped
+    {
+        s->oldest = NextSector(s, sector);
+        s->firstChunk = s->index[s->oldest];
+    }
+
+    return StartSector(s, sector, s->seq + 1, chunk, first);
+}
+
+static uint8_t Reset(W25QXX_LZ_Stream *s, uint32_t base, uint32_t size, uint32_t *index, uint32_t indexSize)
+{
+    s->base = base;
+    s->size = size;
+    s->sectors = size / SECTOR_SIZE;
+    s->head = 0;
+    s->oldest = 0;
+    s->seq = 0;
+    s->wrOffset = SECTOR_HEADER_SIZE;
+    s->firstChunk = 0;
+    s->chunkCount = 0;
+    s->index = index;
+    s->indexSize = indexSize;
+    s->failed = false;
+    s->fill = 0;
+
+    return base % SECTOR_SIZE == 0 && size % SECTOR_SIZE == 0 && s->sectors >= 2 &&
+           index != NULL && indexSize >= s->sectors;
+}
+
+static uint8_t WriteChunk(W25QXX_LZ_Stream *s)
+{
+    uint16_t stored = Compress(s->buf, s->fill, __packed, s->fill);
+    uint8_t *data = __packed;
+    uint16_t storedLen = stored;
+    uint8_t header[CHUNK_HEADER_SIZE];
+    uint32_t sector, offset, end;
+
+    if (s->failed)
+        return false;
+
+    if (stored == 0) // incompressible
+    {
+        data = s->buf;
+        storedLen = s->fill;
+        stored = s->fill | STORED_RAW;
+    }
+
+    s->failed = true; // until the chunk is complete
+
+    // a header doesn't cross a sector boundary
+    if (s->wrOffset + CHUNK_HEADER_SIZE > SECTOR_SIZE)
+    {
+        if (NextHead(s, s->chunkCount, SECTOR_HEADER_SIZE) == false)
+            return false;
+        s->wrOffset = SECTOR_HEADER_SIZE;
+    }
+
+    sector = s->head;
+    offset = s->wrOffset;
+    end = offset + CHUNK_HEADER_SIZE + storedLen;
+
+    // header first, a torn one is detected by its check, then the data and the commit
+    Write16(header, stored);
+    Write16(header + 2, s->fill);
+    Write16(header + 4, W25QXX_SUM_Crc16(0xFFFF, header, 4));
+
+    if (W25QXX_ProgramBytes(SectorAddr(s, sector) + offset, header, 6) == false)
+        return false;
+
+    if (end > SECTOR_SIZE)
+    {
+        s->wrOffset = SECTOR_HEADER_SIZE + end - SECTOR_SIZE;
+        if (NextHead(s, s->chunkCount + 1, (uint16_t)s->wrOffset) == false)
+            return false;
+    }
+    else
+        s->wrOffset = end;
+
+    Write16(header + 6, 0);
+
+    if (ProgramSpan(s, sector, offset + CHUNK_HEADER_SIZE, data, storedLen) == false ||
+        W25QXX_ProgramBytes(SectorAddr(s, sector) + offset + 6, header + 6, 2) == false)
+        return false;
+
+    s->chunkCount++;
+    s->failed = false;
+    s->fill = 0;
+
+    return true;
+}
+
+//-----------------------------------------------
+
+uint8_t W25QXX_LZ_Format(W25QXX_LZ_Stream *s, uint32_t base, uint32_t size, uint32_t *index, uint32_t indexSize)
+{
+    uint32_t sector;
+
+    if (Reset(s, base, size, index, indexSize) == false)
+        return false;
+
+    for (sector = 1; sector < s->sectors; sector++)
+    {
+        if (W25QXX_Erase(SectorAddr(s, sector), W25QXX_ERASE_SECTOR) != W25QXX_ERR_NONE)
+            return false;
+    }
+
+    return StartSector(s, 0, 0, 0, SECTOR_HEADER_SIZE);
+}
+
+uint8_t W25QXX_LZ_Open(W25QXX_LZ_Stream *s, uint32_t base, uint32_t size, uint32_t *index, uint32_t indexSize)
+{
+    SectorHeader h, head = {0, 0, 0};
+    ChunkHeader c;
+    uint32_t sector, offset, k;
+
+    if (Reset(s, base, size, index, indexSize) == false)
+        return false;
+
+    // the head has the highest sequence number
+    for (sector = 0; sector < s->sectors; sector++)
+    {
+        if (ReadSectorHeader(s, sector, &h) == false)
+            return false;
+
+        if (h.first != 0 && (head.first == 0 || (int32_t)(h.seq - head.seq) > 0))
+        {
+            head = h;
+            s->head = sector;
+        }
+    }
+
+    if (head.first == 0)
+        return false; // not a stream
+
+    s->seq = head.seq;
+    s->oldest = s->head;
+    s->index[s->head] = head.chunk;
+
+    // the sectors before it with consecutive numbers are retained
+    for (k = 1; k < s->sectors; k++)
+    {
+        sector = (s->oldest + s->sectors - 1) % s->sectors;
+
+        if (ReadSectorHeader(s, sector, &h) == false)
+            return false;
+
+        if (h.first == 0 || h.seq != head.seq - k)
+            break;
+
+        s->index[sector] = h.chunk;
+        s->oldest = sector;
+    }
+
+    s->firstChunk = s->index[s->oldest];
+    s->chunkCount = head.chunk;
+
+    // walk the headers of the head sector
+    offset = head.first;
+    while (offset + CHUNK_HEADER_SIZE <= SECTOR_SIZE)
+    {
+        if (ReadChunkHeader(s, s->head, offset, &c) == false)
+            return false;
+
+        if (c.state == CHUNK_BLANK)
+            break;
+
+        if (c.state == CHUNK_TORN)
+        {
+            offset += CHUNK_HEADER_SIZE;
+            continue;
+        }
+
+        s->chunkCount++; // an open chunk keeps its number, it reads as corrupted
+        offset += CHUNK_HEADER_SIZE + STORED_SIZE(c.stored);
+    }
+
+    // a chunk cut before the next sector was started ends the head sector
+    s->wrOffset = offset < SECTOR_SIZE ? offset : SECTOR_SIZE;
+
+    return true;
+}
+
+uint8_t W25QXX_LZ_Write(W25QXX_LZ_Stream *s, uint8_t *buf, uint32_t len)
+{
+    uint16_t n;
+
+    while (len > 0)
+    {
+        n = CHUNK_SIZE - s->fill;
+        if (n > len)
+            n = (uint16_t)len;
+
+        memcpy(s->buf + s->fill, buf, n);
+        s->fill += n;
+        buf += n;
+        len -= n;
+
+        if (s->fill == CHUNK_SIZE && WriteChunk(s) == false)
+            return false;
+    }
+
+    return true;
+}
+
+uint8_t W25QXX_LZ_Flush(W25QXX_LZ_Stream *s)
+{
+    if (s->fill == 0)
+        return true;
+
+    return WriteChunk(s);
+}
+
+uint16_t W25QXX_LZ_ReadChunk(W25QXX_LZ_Stream *s, uint32_t chunk, uint8_t *buf)
+{
+    SectorHeader h;
+    ChunkHeader c;
+    uint32_t sector = s->oldest, offset, n;
+
+    if (chunk < s->firstChunk || chunk >= s->chunkCount)
+        return 0;
+
+    // the last sector where a chunk <= 'chunk' starts
+    while (sector != s->head && s->index[NextSector(s, sector)] <= chunk)
+        sector = NextSector(s, sector);
+
+    if (ReadSectorHeader(s, sector, &h) == false || h.first == 0)
+        return 0;
+
+    n = s->index[sector];
+    offset = h.first;
+
+    while (1)
+    {
+        if (offset + CHUNK_HEADER_SIZE > SECTOR_SIZE || ReadChunkHeader(s, sector, offset, &c) == false ||
+            c.state == CHUNK_BLANK)
+            return 0;
+
+        if (c.state == CHUNK_TORN)
+        {
+            offset += CHUNK_HEADER_SIZE;
+            continue;
+        }
+
+        if (n == chunk)
+            break;
+
+        n++;
+        offset += CHUNK_HEADER_SIZE + STORED_SIZE(c.stored);
+    }
+
+    if (c.state != CHUNK_DONE)
+        return 0;
+
+    offset += CHUNK_HEADER_SIZE;
+
+    if (c.stored & STORED_RAW)
+        return ReadSpan(s, sector, offset, buf, c.raw) ? c.raw : 0;
+
+    if (ReadSpan(s, sector, offset, __packed, c.stored) == false)
+        return 0;
+
+    if (Decompress(__packed, c.stored, buf, CHUNK_SIZE) != c.raw)
+        return 0;
+
+    return c.raw;
+}
+
+uint32_t W25QXX_LZ_FirstChunk(W25QXX_LZ_Stream *s)
+{
+    return s->firstChunk;
+}
+
+uint32_t W25QXX_LZ_ChunkCount(W25QXX_LZ_Stream *s)
+{
+    return s->chunkCount;
+}
+
+uint32_t W25QXX_LZ_UsedBytes(W25QXX_LZ_Stream *s)
+{
+    return ((s->head + s->sectors - s->oldest) % s->sectors) * SECTOR_SIZE + s->wrOffset;
+}
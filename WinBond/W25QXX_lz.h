@@ -0,0 +1,99 @@
+#ifndef _H_W25QXX_LZ
+#define _H_W25QXX_LZ
+
+#include "W25QXX.h"
+
+/**
+ * *****************************************************
+ *
+ * compressed stream on a flash region
+ *
+ * data is cut into chunks of 'W25QXX_LZ_CHUNK_SIZE' raw bytes, each chunk
+ * is compressed on its own (LZ4 block format) and appended to the region
+ * behind an 8 byte header, so any chunk can be decoded without the others.
+ * chunks which don't shrink are stored as they are.
+ *
+ * the region is a ring of sectors, each one starts with a header holding
+ * a sequence number and where its first chunk is. when the region is full
+ * the oldest sector is erased and its chunks are dropped, chunks keep
+ * their numbers: the retained ones are
+ * [W25QXX_LZ_FirstChunk(), W25QXX_LZ_ChunkCount()).
+ *
+ * the chunk header is programmed first and has a CRC16 of its sizes, the
+ * commit field is cleared after the data: a chunk cut by a power loss
+ * reads as corrupted after 'W25QXX_LZ_Open()', a torn header is skipped.
+ * headers are checked with 'W25QXX_SUM_Crc16()', link "W25QXX_sum.c".
+ *
+ * optional settings at "W25QXX_conf.h":
+ *   W25QXX_LZ_CHUNK_SIZE  raw chunk size, multiple of the page size
+ *   W25QXX_LZ_HASH_LOG    match finder size: 2^n * 2 bytes of RAM
+ *
+ * *****************************************************
+*/
+
+#ifndef W25QXX_LZ_CHUNK_SIZE
+#define W25QXX_LZ_CHUNK_SIZE 1024
+#endif
+
+#ifndef W25QXX_LZ_HASH_LOG
+#define W25QXX_LZ_HASH_LOG 8
+#endif
+
+// a chunk spans two sectors at most
+#if (W25QXX_LZ_CHUNK_SIZE % W25QXX_PAGE_SIZE) != 0 || W25QXX_LZ_CHUNK_SIZE > (W25QXX_SECTOR_SIZE / 2)
+#error "'W25QXX_LZ_CHUNK_SIZE' must be a multiple of the page size and at most half a sector"
+#endif
+
+typedef struct
+{
+    uint32_t base; // sector aligned
+    uint32_t size; // multiple of the sector size
+    uint32_t sectors;
+    uint32_t head;       // sector being written
+    uint32_t oldest;     // oldest retained sector
+    uint32_t seq;        // sequence number of the head sector
+    uint32_t wrOffset;   // in the head sector
+    uint32_t firstChunk; // oldest retained chunk
+    uint32_t chunkCount; // number of the next chunk
+
+    // index[sector] is the first chunk starting in the sector
+    uint32_t *index;
+    uint32_t indexSize;
+
+    uint8_t failed; // a write failed, 'W25QXX_LZ_Open()' again
+
+    uint16_t fill;
+    uint8_t buf[W25QXX_LZ_CHUNK_SIZE];
+} W25QXX_LZ_Stream;
+
+/**
+ * open a region of at least 2 sectors
+ *
+ * 'index' is a caller provided array of one entry per sector, they fail
+ * when 'indexSize' is smaller. 'W25QXX_LZ_Open()' fails if the region
+ * doesn't hold a stream
+*/
+
+uint8_t W25QXX_LZ_Format(W25QXX_LZ_Stream *s, uint32_t base, uint32_t size, uint32_t *index, uint32_t indexSize);
+uint8_t W25QXX_LZ_Open(W25QXX_LZ_Stream *s, uint32_t base, uint32_t size, uint32_t *index, uint32_t indexSize);
+
+/**
+ * write, data is buffered until a chunk is full or 'W25QXX_LZ_Flush()'
+ * after a failed write the stream has to be opened again
+*/
+
+uint8_t W25QXX_LZ_Write(W25QXX_LZ_Stream *s, uint8_t *buf, uint32_t len);
+uint8_t W25QXX_LZ_Flush(W25QXX_LZ_Stream *s);
+
+/**
+ * read a chunk into 'buf' (W25QXX_LZ_CHUNK_SIZE bytes)
+ * return the raw size of the chunk, 0 if it doesn't exist or is corrupted
+*/
+
+uint16_t W25QXX_LZ_ReadChunk(W25QXX_LZ_Stream *s, uint32_t chunk, uint8_t *buf);
+
+uint32_t W25QXX_LZ_FirstChunk(W25QXX_LZ_Stream *s);
+uint32_t W25QXX_LZ_ChunkCount(W25QXX_LZ_Stream *s);
+uint32_t W25QXX_LZ_UsedBytes(W25QXX_LZ_Stream *s); // flash bytes in use
+
+#endif
@@ -0,0 +1,195 @@
+#include "W25QXX_ota.h"
+#include "W25QXX_sum.h"
+#include <string.h>
+
+#define PAGE_SIZE W25QXX_PAGE_SIZE
+
+#undef true
+#define true 1
+
+#undef false
+#define false 0
+
+#define HEADER_MAGIC 0x3141544FUL // "OTA1"
+
+//------------------- internal func -------------------
+
+static uint32_t SlotAddr(uint8_t slot)
+{
+    return slot == 0 ? W25QXX_OTA_SLOT_A : W25QXX_OTA_SLOT_B;
+}
+
+// erase the next unit of the image area, as large as alignment allows
+static uint8_t EraseNext(W25QXX_OTA_Writer *w)
+{
+    uint32_t addr = w->base + w->erasedEnd;
+    uint32_t remain = W25QXX_OTA_IMAGE_MAX - w->erasedEnd;
+    W25QXX_EraseType type = W25QXX_ERASE_SECTOR;
+    uint32_t size = W25QXX_SECTOR_SIZE;
+
+    if (remain == 0)
+        return true;
+
+    if (addr % W25QXX_BLOCK_SIZE == 0 && remain >= W25QXX_BLOCK_SIZE)
+    {
+        type = W25QXX_ERASE_BLOCK;
+        size = W25QXX_BLOCK_SIZE;
+    }
+    else if (addr % W25QXX_HALF_BLOCK_SIZE == 0 && remain >= W25QXX_HALF_BLOCK_SIZE)
+    {
+        type = W25QXX_ERASE_HALF_BLOCK;
+        size = W25QXX_HALF_BLOCK_SIZE;
+    }
+
+    if (W25QXX_Erase(addr, type) != W25QXX_ERR_NONE)
+        return false;
+
+    w->erasedEnd += size;
+
+    return true;
+}
+
+static uint8_t FlushPage(W25QXX_OTA_Writer *w)
+{
+    uint32_t addr = w->offset - w->fill;
+    uint16_t size = w->fill;
+
+    if (size == 0)
+        return true;
+
+    if (W25QXX_ProgramBytes(w->base + addr, w->page, size) == false)
+        return false;
+
+    w->fill = 0;
+
+    // the current unit is full, start erasing the next one right away
+    if (size == PAGE_SIZE && addr + PAGE_SIZE >= w->erasedEnd)
+        return EraseNext(w);
+
+    return true;
+}
+
+//-----------------------------------------------
+
+uint8_t W25QXX_OTA_ReadHeader(uint8_t slot, W25QXX_OTA_Header *header)
+{
+    if (W25QXX_ReadBytes(SlotAddr(slot) + W25QXX_OTA_HEADER_OFFSET, (uint8_t *)header, sizeof(W25QXX_OTA_Header)) != W25QXX_ERR_NONE)
+        return false;
+
+    return header->magic == HEADER_MAGIC &&
+           header->size <= W25QXX_OTA_IMAGE_MAX &&
+           header->headerCrc == W25QXX_SUM_Crc32(0, (uint8_t *)header, sizeof(W25QXX_OTA_Header) - sizeof(uint32_t));
+}
+
+uint8_t W25QXX_OTA_GetActive(void)
+{
+    W25QXX_OTA_Header a, b;
+    uint8_t validA = W25QXX_OTA_ReadHeader(0, &a);
+    uint8_t validB = W25QXX_OTA_ReadHeader(1, &b);
+
+    if (validA && validB)
+        return (int32_t)(b.seq - a.seq) > 0 ? 1 : 0;
+
+    if (validA)
+        return 0;
+
+    if (validB)
+        return 1;
+
+    return W25QXX_OTA_SLOT_NONE;
+}
+
+uint32_t W25QXX_OTA_ImageAddr(uint8_t slot)
+{
+    return SlotAddr(slot);
+}
+
+uint8_t W25QXX_OTA_Verify(uint8_t slot)
+{
+    W25QXX_OTA_Header header;
+    uint8_t buf[PAGE_SIZE];
+    uint32_t addr, remain, len, crc = 0;
+
+    if (!W25QXX_OTA_ReadHeader(slot, &header))
+        return false;
+
+    addr = W25QXX_OTA_ImageAddr(slot);
+
+    for (remain = header.size; remain > 0; remain -= len)
+    {
+        len = remain > PAGE_SIZE ? PAGE_SIZE : remain;
+        if (W25QXX_ReadBytes(addr, buf, len) != W25QXX_ERR_NONE)
+            return false;
+        crc = W25QXX_SUM_Crc32(crc, buf, len);
+        addr += len;
+    }
+
+    return crc == header.crc;
+}
+
+uint8_t W25QXX_OTA_Open(W25QXX_OTA_Writer *w)
+{
+    uint8_t active = W25QXX_OTA_GetActive();
+
+    w->slot = active == 0 ? 1 : 0;
+    w->base = W25QXX_OTA_ImageAddr(w->slot);
+    w->offset = 0;
+    w->erasedEnd = 0;
+    w->crc = 0;
+    w->fill = 0;
+
+    // invalidate the slot first
+    if (W25QXX_Erase(SlotAddr(w->slot) + W25QXX_OTA_HEADER_OFFSET, W25QXX_ERASE_SECTOR) != W25QXX_ERR_NONE)
+        return false;
+
+    return EraseNext(w);
+}
+
+uint8_t W25QXX_OTA_Write(W25QXX_OTA_Writer *w, uint8_t *buf, uint32_t len)
+{
+    uint16_t n;
+
+    if (w->offset + len > W25QXX_OTA_IMAGE_MAX)
+        return false;
+
+    w->crc = W25QXX_SUM_Crc32(w->crc, buf, len);
+
+    while (len > 0)
+    {
+        n = PAGE_SIZE - w->fill;
+        if (n > len)
+            n = (uint16_t)len;
+
+        memcpy(w->page + w->fill, buf, n);
+        w->fill += n;
+        w->offset += n;
+        buf += n;
+        len -= n;
+
+        if (w->fill == PAGE_SIZE && FlushPage(w) == false)
+            return false;
+    }
+
+    return true;
+}
+
+uint32_t W25QXX_OTA_GetCrc(W25QXX_OTA_Writer *w)
+{
+    return w->crc;
+}
+
+uint8_t W25QXX_OTA_Finalize(W25QXX_OTA_Writer *w)
+{
+    W25QXX_OTA_Header header, other;
+
+    if (FlushPage(w) == false)
+        return false;
+
+    header.magic = HEADER_MAGIC;
+    header.seq = W25QXX_OTA_ReadHeader(w->slot ^ 1, &other) ? other.seq + 1 : 0;
+    header.size = w->offset;
+    header.crc = w->crc;
+    header.headerCrc = W25QXX_SUM_Crc32(0, (uint8_t *)&header, sizeof(W25QXX_OTA_Header) - sizeof(uint32_t));
+
+    return W25QXX_ProgramBytes(SlotAddr(w->slot) + W25QXX_OTA_HEADER_OFFSET, (uint8_t *)&header, sizeof(W25QXX_OTA_Header));
+}
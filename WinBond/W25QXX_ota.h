@@ -0,0 +1,79 @@
+#ifndef _H_W25QXX_OTA
+#define _H_W25QXX_OTA
+
+#include "W25QXX.h"
+
+/**
+ * *****************************************************
+ *
+ * streaming firmware image writer with A/B slots
+ *
+ * the image starts at the slot address, the last sector of the slot holds
+ * the header. the header is only written by 'W25QXX_OTA_Finalize()', with
+ * a sequence number one above the other slot, so the switch to the new
+ * image is atomic.
+ *
+ * the image area is erased in the largest units possible, 64KB blocks
+ * when the slots are 64KB aligned. the next unit is erased as soon as the
+ * previous one is full so the erase runs while the next chunk is being
+ * received.
+ *
+ * the CRC32 is 'W25QXX_SUM_Crc32()', link "W25QXX_sum.c".
+ *
+ * settings at "W25QXX_conf.h":
+ *   W25QXX_OTA_SLOT_A     address of slot A, 64KB aligned is best
+ *   W25QXX_OTA_SLOT_B     address of slot B, 64KB aligned is best
+ *   W25QXX_OTA_SLOT_SIZE  size of a slot, header sector included
+ *
+ * *****************************************************
+*/
+
+#if !defined(W25QXX_OTA_SLOT_A) || !defined(W25QXX_OTA_SLOT_B) || !defined(W25QXX_OTA_SLOT_SIZE)
+#error "macro 'W25QXX_OTA_SLOT_A', 'W25QXX_OTA_SLOT_B' and 'W25QXX_OTA_SLOT_SIZE' must be defined"
+#endif
+
+#define W25QXX_OTA_SLOT_NONE 0xFF
+#define W25QXX_OTA_HEADER_OFFSET (W25QXX_OTA_SLOT_SIZE - W25QXX_SECTOR_SIZE)
+#define W25QXX_OTA_IMAGE_MAX W25QXX_OTA_HEADER_OFFSET
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t size; // image size
+    uint32_t crc;  // CRC32 of the image
+    uint32_t headerCrc;
+} W25QXX_OTA_Header;
+
+typedef struct
+{
+    uint8_t slot;
+    uint32_t base;
+    uint32_t offset;    // bytes received
+    uint32_t erasedEnd; // relative to base
+    uint32_t crc;
+    uint16_t fill;
+    uint8_t page[W25QXX_PAGE_SIZE];
+} W25QXX_OTA_Writer;
+
+/**
+ * slot information
+ *
+ * return W25QXX_OTA_SLOT_NONE if no slot holds a valid image
+*/
+
+uint8_t W25QXX_OTA_GetActive(void);
+uint8_t W25QXX_OTA_ReadHeader(uint8_t slot, W25QXX_OTA_Header *header);
+uint32_t W25QXX_OTA_ImageAddr(uint8_t slot);
+uint8_t W25QXX_OTA_Verify(uint8_t slot); // re-read the image and check its CRC
+
+/**
+ * write an image into the inactive slot
+*/
+
+uint8_t W25QXX_OTA_Open(W25QXX_OTA_Writer *w);
+uint8_t W25QXX_OTA_Write(W25QXX_OTA_Writer *w, uint8_t *buf, uint32_t len);
+uint32_t W25QXX_OTA_GetCrc(W25QXX_OTA_Writer *w); // CRC32 of the data written so far
+uint8_t W25QXX_OTA_Finalize(W25QXX_OTA_Writer *w);
+
+#endif
@@ -0,0 +1,133 @@
+#include "W25QXX_pipe.h"
+#include <string.h>
+
+#define PAGE_SIZE W25QXX_PAGE_SIZE
+
+#undef true
+#define true 1
+
+#undef false
+#define false 0
+
+//------------------- internal func -------------------
+
+// free bytes of the fill buffer, up to the end of its page
+static uint16_t Room(W25QXX_PIPE_Writer *w)
+{
+    return PAGE_SIZE - (w->addr % PAGE_SIZE) - w->fill;
+}
+
+// finish the running transfer (DMA), the chip starts programming
+static void Finish(W25QXX_PIPE_Writer *w)
+{
+    if (w->pending)
+    {
+        W25QXX_ProgramEnd();
+        w->pending = false;
+    }
+}
+
+// send the fill buffer and switch to the other one
+static W25QXX_ErrorCode Handover(W25QXX_PIPE_Writer *w)
+{
+    W25QXX_ErrorCode err;
+
+    Finish(w);
+
+    // waits for the page sent before, it was programmed while this one was filled
+    err = W25QXX_ProgramBegin(w->addr, w->page[w->cur], w->fill);
+    if (err != W25QXX_ERR_NONE)
+        return err;
+
+    // without a hook the data is sent already, end it so the chip programs now
+    if (W25QXX_GetBulkHook() == NULL)
+        W25QXX_ProgramEnd();
+    else
+        w->pending = true;
+
+    w->addr += w->fill;
+    w->fill = 0;
+    w->cur ^= 1;
+
+    return W25QXX_ERR_NONE;
+}
+
+//-----------------------------------------------
+
+W25QXX_ErrorCode W25QXX_PIPE_Open(W25QXX_PIPE_Writer *w, uint32_t addr)
+{
+    w->addr = addr;
+    w->fill = 0;
+    w->cur = 0;
+    w->pending = false;
+
+    return W25QXX_ERR_NONE;
+}
+
+W25QXX_ErrorCode W25QXX_PIPE_Write(W25QXX_PIPE_Writer *w, const uint8_t *buf, uint32_t len)
+{
+    W25QXX_ErrorCode err;
+    uint16_t n;
+
+    Finish(w);
+
+    while (len > 0)
+    {
+        n = Room(w);
+        if (n > len)
+            n = (uint16_t)len;
+
+        memcpy(w->page[w->cur] + w->fill, buf, n);
+        w->fill += n;
+        buf += n;
+        len -= n;
+
+        if (Room(w) == 0)
+        {
+            err = Handover(w);
+            if (err != W25QXX_ERR_NONE)
+                return err;
+        }
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+uint8_t *W25QXX_PIPE_GetBuffer(W25QXX_PIPE_Writer *w, uint16_t *room)
+{
+    Finish(w);
+
+    *room = Room(w);
+
+    return w->page[w->cur] + w->fill;
+}
+
+W25QXX_ErrorCode W25QXX_PIPE_Commit(W25QXX_PIPE_Writer *w, uint16_t len)
+{
+    if (len > Room(w))
+        return W25QXX_ERR_FAILED;
+
+    w->fill += len;
+
+    if (Room(w) == 0)
+        return Handover(w);
+
+    return W25QXX_ERR_NONE;
+}
+
+W25QXX_ErrorCode W25QXX_PIPE_Flush(W25QXX_PIPE_Writer *w)
+{
+    W25QXX_ErrorCode err = W25QXX_ERR_NONE;
+
+    if (w->fill > 0)
+        err = Handover(w);
+
+    Finish(w);
+
+    return err;
+}
+
+uint32_t W25QXX_PIPE_Tell(W25QXX_PIPE_Writer *w)
+{
+    return w->addr + w->fill;
+}
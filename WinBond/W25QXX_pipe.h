@@ -0,0 +1,53 @@
+#ifndef _H_W25QXX_PIPE
+#define _H_W25QXX_PIPE
+
+#include "W25QXX.h"
+
+/**
+ * *****************************************************
+ *
+ * pipelined writer with two page buffers
+ *
+ * the application fills one buffer while the chip programs the other.
+ * a full buffer is handed over at once: the busy wait for the previous
+ * page is done there, then the page is sent and programmed. with the bulk
+ * hook ('W25QXX_SetBulkHook()') the call returns while the transfer runs,
+ * the next call to the writer finishes it, which starts the page program.
+ *
+ * the target area must be erased, nothing is erased by the writer.
+ * call 'W25QXX_PIPE_Flush()' before any other call to the driver.
+ *
+ *   W25QXX_PIPE_Open(&w, addr);
+ *   while (capturing)
+ *   {
+ *       buf = W25QXX_PIPE_GetBuffer(&w, &room); // or W25QXX_PIPE_Write()
+ *       ... fill up to 'room' bytes
+ *       W25QXX_PIPE_Commit(&w, len);
+ *   }
+ *   W25QXX_PIPE_Flush(&w);
+ *
+ * *****************************************************
+*/
+
+typedef struct
+{
+    uint32_t addr;   // flash address of the fill buffer
+    uint16_t fill;   // bytes in the fill buffer
+    uint8_t cur;     // index of the fill buffer
+    uint8_t pending; // the other buffer is still being sent
+    uint8_t page[2][W25QXX_PAGE_SIZE];
+} W25QXX_PIPE_Writer;
+
+W25QXX_ErrorCode W25QXX_PIPE_Open(W25QXX_PIPE_Writer *w, uint32_t addr);
+W25QXX_ErrorCode W25QXX_PIPE_Write(W25QXX_PIPE_Writer *w, const uint8_t *buf, uint32_t len);
+W25QXX_ErrorCode W25QXX_PIPE_Flush(W25QXX_PIPE_Writer *w); // program the last partial page
+uint32_t W25QXX_PIPE_Tell(W25QXX_PIPE_Writer *w);          // flash address of the next byte
+
+/**
+ * zero copy, fill the buffer in place
+*/
+
+uint8_t *W25QXX_PIPE_GetBuffer(W25QXX_PIPE_Writer *w, uint16_t *room);
+W25QXX_ErrorCode W25QXX_PIPE_Commit(W25QXX_PIPE_Writer *w, uint16_t len);
+
+#endif
@@ -0,0 +1,177 @@
+#include "W25QXX_plan.h"
+#include "W25QXX_sum.h"
+#include <string.h>
+
+#define PAGE_SIZE W25QXX_PAGE_SIZE
+#define SECTOR_SIZE W25QXX_SECTOR_SIZE
+
+#define HEADER_SIZE 20
+#define OP_SIZE 5
+
+// parser state, the field being received
+#define STATE_HEADER 0
+#define STATE_OP 1
+#define STATE_LEN 2
+#define STATE_DATA 3
+#define STATE_FAILED 4
+
+//------------------- internal func -------------------
+
+static uint32_t GetU32(const uint8_t *buf)
+{
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static uint8_t IsInImage(W25QXX_PLAN_Executor *x, uint32_t addr, uint32_t len)
+{
+    return addr >= x->addr && len <= x->len && addr - x->addr <= x->len - len;
+}
+
+static uint32_t EraseSize(uint8_t type)
+{
+    switch (type)
+    {
+    case W25QXX_ERASE_SECTOR:
+        return SECTOR_SIZE;
+    case W25QXX_ERASE_HALF_BLOCK:
+        return W25QXX_HALF_BLOCK_SIZE;
+    case W25QXX_ERASE_BLOCK:
+        return W25QXX_BLOCK_SIZE;
+    default:
+        return 0;
+    }
+}
+
+static void Expect(W25QXX_PLAN_Executor *x, uint8_t state, uint16_t need)
+{
+    x->state = state;
+    x->need = need;
+    x->fill = 0;
+}
+
+// a field is complete in 'buf'
+static W25QXX_ErrorCode Process(W25QXX_PLAN_Executor *x)
+{
+    W25QXX_ErrorCode err;
+    uint32_t size;
+
+    switch (x->state)
+    {
+    case STATE_HEADER:
+        if (GetU32(x->buf) != W25QXX_PLAN_MAGIC)
+            return W25QXX_ERR_FAILED;
+
+        x->addr = GetU32(x->buf + 4);
+        x->len = GetU32(x->buf + 8);
+        x->crc = GetU32(x->buf + 12);
+        x->ops = GetU32(x->buf + 16);
+
+        if (x->addr % SECTOR_SIZE != 0 || x->len % SECTOR_SIZE != 0 || x->len == 0 ||
+            x->addr >= W25QXX_FLASH_SIZE || x->len > W25QXX_FLASH_SIZE - x->addr)
+            return W25QXX_ERR_FAILED;
+
+        if (W25QXX_IsProtected(x->addr, x->len))
+            return W25QXX_ERR_PROTECTED;
+
+        Expect(x, STATE_OP, OP_SIZE);
+        break;
+    case STATE_OP:
+        x->op = GetU32(x->buf + 1);
+
+        if (x->buf[0] == W25QXX_PLAN_PROGRAM)
+        {
+            Expect(x, STATE_LEN, 1);
+            break;
+        }
+
+        size = EraseSize(x->buf[0]);
+        if (size == 0 || x->op % size != 0 || IsInImage(x, x->op, size) == 0)
+            return W25QXX_ERR_FAILED;
+
+        err = W25QXX_Erase(x->op, (W25QXX_EraseType)x->buf[0]);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        x->done++;
+        Expect(x, STATE_OP, OP_SIZE);
+        break;
+    case STATE_LEN:
+        size = (uint32_t)x->buf[0] + 1;
+        if (x->op % PAGE_SIZE + size > PAGE_SIZE || IsInImage(x, x->op, size) == 0)
+            return W25QXX_ERR_FAILED;
+
+        Expect(x, STATE_DATA, (uint16_t)size);
+        break;
+    default: // STATE_DATA
+        if (W25QXX_ProgramBytes(x->op, x->buf, x->need) == 0)
+            return W25QXX_ERR_FAILED;
+
+        x->done++;
+        Expect(x, STATE_OP, OP_SIZE);
+        break;
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+//-----------------------------------------------
+
+void W25QXX_PLAN_Begin(W25QXX_PLAN_Executor *x)
+{
+    x->done = 0;
+    x->ops = 0;
+    Expect(x, STATE_HEADER, HEADER_SIZE);
+}
+
+W25QXX_ErrorCode W25QXX_PLAN_Feed(W25QXX_PLAN_Executor *x, const uint8_t *buf, uint32_t len)
+{
+    W25QXX_ErrorCode err;
+    uint32_t n;
+
+    if (x->state == STATE_FAILED)
+        return W25QXX_ERR_FAILED;
+
+    while (len > 0)
+    {
+        n = x->need - x->fill;
+        if (n > len)
+            n = len;
+
+        memcpy(x->buf + x->fill, buf, n);
+        x->fill += (uint16_t)n;
+        buf += n;
+        len -= n;
+
+        if (x->fill == x->need)
+        {
+            err = Process(x);
+            if (err != W25QXX_ERR_NONE)
+            {
+                x->state = STATE_FAILED; // the rest of the plan is useless
+                return err;
+            }
+        }
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+W25QXX_ErrorCode W25QXX_PLAN_End(W25QXX_PLAN_Executor *x)
+{
+    W25QXX_ErrorCode err;
+    uint32_t offset, crc = 0;
+
+    if (x->state != STATE_OP || x->fill != 0 || x->done != x->ops)
+        return W25QXX_ERR_FAILED;
+
+    for (offset = 0; offset < x->len; offset += PAGE_SIZE)
+    {
+        err = W25QXX_ReadBytes(x->addr + offset, x->buf, PAGE_SIZE);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        crc = W25QXX_SUM_Crc32(crc, x->buf, PAGE_SIZE);
+    }
+
+    return crc == x->crc ? W25QXX_ERR_NONE : W25QXX_ERR_FAILED;
+}
@@ -0,0 +1,64 @@
+#ifndef _H_W25QXX_PLAN
+#define _H_W25QXX_PLAN
+
+#include "W25QXX.h"
+
+/**
+ * *****************************************************
+ *
+ * executor for update plans made by the host tool "host/plan"
+ *
+ * a plan turns the image in the flash into a new one with only the erases
+ * and page programs needed, it's fed in chunks of any size as it arrives
+ * (UART, USB ...), each operation is done as soon as it's complete.
+ * 'W25QXX_PLAN_End()' checks that the plan is complete and the CRC32 of
+ * the result, with 'W25QXX_SUM_Crc32()', link "W25QXX_sum.c". a plan cut
+ * by a reset can be run again from the start.
+ *
+ * format, little endian:
+ *
+ *   header   u32 magic "NFP1", u32 addr, u32 len, u32 crc, u32 ops
+ *            [addr, addr + len) is the image, sector aligned,
+ *            'crc' is its CRC32 after the update
+ *   erase    u8 type (W25QXX_ERASE_SECTOR/HALF_BLOCK/BLOCK), u32 addr
+ *   program  u8 0x02, u32 addr, u8 len - 1, data, within one page
+ *
+ *   W25QXX_PLAN_Begin(&x);
+ *   while ((n = uart_read(buf, sizeof(buf))) > 0)
+ *       if (W25QXX_PLAN_Feed(&x, buf, n) != W25QXX_ERR_NONE) ...
+ *   W25QXX_PLAN_End(&x);
+ *
+ * *****************************************************
+*/
+
+#define W25QXX_PLAN_MAGIC 0x3150464EUL // "NFP1"
+#define W25QXX_PLAN_PROGRAM 0x02U
+
+typedef struct
+{
+    uint8_t state;
+    uint16_t need; // bytes of the current field
+    uint16_t fill; // bytes of it received
+    uint32_t op;   // address of the current operation
+    uint32_t addr; // image
+    uint32_t len;
+    uint32_t crc;
+    uint32_t ops;  // operations in the plan
+    uint32_t done; // operations done
+    uint8_t buf[W25QXX_PAGE_SIZE];
+} W25QXX_PLAN_Executor;
+
+void W25QXX_PLAN_Begin(W25QXX_PLAN_Executor *x);
+
+/**
+ * W25QXX_ERR_FAILED on a malformed plan or an operation outside the image,
+ * W25QXX_ERR_PROTECTED when the image is write protected
+*/
+W25QXX_ErrorCode W25QXX_PLAN_Feed(W25QXX_PLAN_Executor *x, const uint8_t *buf, uint32_t len);
+
+/**
+ * W25QXX_ERR_FAILED if the plan is incomplete or the result has a wrong CRC
+*/
+W25QXX_ErrorCode W25QXX_PLAN_End(W25QXX_PLAN_Executor *x);
+
+#endif
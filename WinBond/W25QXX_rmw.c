@@ -0,0 +1,247 @@
+#include "W25QXX_rmw.h"
+#include "W25QXX_sum.h"
+
+#define PAGE_SIZE W25QXX_PAGE_SIZE
+#define SECTOR_SIZE W25QXX_SECTOR_SIZE
+
+#undef true
+#define true 1
+
+#undef false
+#define false 0
+
+#define SCRATCH_ADDR W25QXX_RMW_SCRATCH
+#define LOG_ADDR (W25QXX_RMW_SCRATCH + SECTOR_SIZE)
+
+#define RECORD_MAGIC 0x31574D52UL // "RMW1"
+#define RECORD_NUM (SECTOR_SIZE / sizeof(Record))
+#define RECORD_DONE_OFFSET 12
+#define SLOT_INVALID 0xFFFF // 'W25QXX_RMW_Init()' not called yet
+
+// one update, written after the scratch sector is staged,
+// 'done' is programmed to 0 once the target is copied back
+typedef struct
+{
+    uint32_t magic;
+    uint32_t target; // sector address
+    uint32_t crc;    // CRC32 of the staged sector
+    uint32_t done;
+} Record;
+
+//------------------- internal func -------------------
+
+static uint8_t __page[PAGE_SIZE];
+static uint16_t __slot = SLOT_INVALID; // next free record
+
+static uint8_t IsBlank(const uint8_t *buf, uint32_t len)
+{
+    while (len--)
+    {
+        if (*buf++ != 0xFF)
+            return false;
+    }
+
+    return true;
+}
+
+static uint8_t IsInArea(uint32_t addr, uint32_t len)
+{
+    return addr < SCRATCH_ADDR + W25QXX_RMW_AREA_SIZE && SCRATCH_ADDR < addr + len;
+}
+
+static W25QXX_ErrorCode ProgramPage(uint32_t addr, uint8_t *buf)
+{
+    // erased pages are left alone
+    if (IsBlank(buf, PAGE_SIZE))
+        return W25QXX_ERR_NONE;
+
+    return W25QXX_ProgramBytes(addr, buf, PAGE_SIZE) ? W25QXX_ERR_NONE : W25QXX_ERR_FAILED;
+}
+
+// CRC32 of the scratch sector
+static W25QXX_ErrorCode ScratchCrc(uint32_t *crc)
+{
+    W25QXX_ErrorCode err;
+    uint32_t offset;
+
+    *crc = 0;
+
+    for (offset = 0; offset < SECTOR_SIZE; offset += PAGE_SIZE)
+    {
+        err = W25QXX_ReadBytes(SCRATCH_ADDR + offset, __page, PAGE_SIZE);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        *crc = W25QXX_SUM_Crc32(*crc, __page, PAGE_SIZE);
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+// erase the target and copy the scratch sector back, then close the record
+static W25QXX_ErrorCode CopyBack(uint32_t target, uint16_t slot)
+{
+    static uint8_t done[4] = {0, 0, 0, 0};
+    W25QXX_ErrorCode err;
+    uint32_t offset;
+
+    err = W25QXX_Erase(target, W25QXX_ERASE_SECTOR);
+    if (err != W25QXX_ERR_NONE)
+        return err;
+
+    for (offset = 0; offset < SECTOR_SIZE; offset += PAGE_SIZE)
+    {
+        err = W25QXX_ReadBytes(SCRATCH_ADDR + offset, __page, PAGE_SIZE);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        err = ProgramPage(target + offset, __page);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+    }
+
+    if (W25QXX_ProgramBytes(LOG_ADDR + slot * sizeof(Record) + RECORD_DONE_OFFSET, done, sizeof(done)) == false)
+        return W25QXX_ERR_FAILED;
+
+    return W25QXX_ERR_NONE;
+}
+
+// stage the merged sector of 'target' into the scratch sector and log it
+static W25QXX_ErrorCode Stage(uint32_t target, uint16_t offset, uint8_t *buf, uint16_t len)
+{
+    W25QXX_ErrorCode err;
+    Record rec;
+    uint32_t page, from, to;
+
+    err = W25QXX_Erase(SCRATCH_ADDR, W25QXX_ERASE_SECTOR);
+    if (err != W25QXX_ERR_NONE)
+        return err;
+
+    rec.crc = 0;
+
+    for (page = 0; page < SECTOR_SIZE; page += PAGE_SIZE)
+    {
+        err = W25QXX_ReadBytes(target + page, __page, PAGE_SIZE);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        // overlay the new data on this page
+        from = offset > page ? offset : page;
+        to = offset + len < page + PAGE_SIZE ? offset + len : page + PAGE_SIZE;
+        for (; from < to; from++)
+            __page[from - page] = buf[from - offset];
+
+        rec.crc = W25QXX_SUM_Crc32(rec.crc, __page, PAGE_SIZE);
+
+        err = ProgramPage(SCRATCH_ADDR + page, __page);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+    }
+
+    // the log is erased only when it's full, the last record is closed by then
+    if (__slot >= RECORD_NUM)
+    {
+        err = W25QXX_Erase(LOG_ADDR, W25QXX_ERASE_SECTOR);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+        __slot = 0;
+    }
+
+    rec.magic = RECORD_MAGIC;
+    rec.target = target;
+    rec.done = 0xFFFFFFFFUL;
+
+    if (W25QXX_ProgramBytes(LOG_ADDR + __slot * sizeof(Record), (uint8_t *)&rec, sizeof(rec)) == false)
+        return W25QXX_ERR_FAILED;
+
+    __slot++;
+
+    return W25QXX_ERR_NONE;
+}
+
+//-----------------------------------------------
+
+W25QXX_ErrorCode W25QXX_RMW_Init(void)
+{
+    W25QXX_ErrorCode err;
+    Record rec, last = {0, 0, 0, 0};
+    uint32_t crc;
+    uint16_t slot;
+
+    // records are appended, the first blank one is the end of the log
+    for (slot = 0; slot < RECORD_NUM; slot++)
+    {
+        err = W25QXX_ReadBytes(LOG_ADDR + slot * sizeof(Record), (uint8_t *)&rec, sizeof(rec));
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        if (IsBlank((uint8_t *)&rec, sizeof(rec)))
+            break;
+
+        last = rec;
+    }
+
+    __slot = slot;
+
+    if (last.magic != RECORD_MAGIC || last.done != 0xFFFFFFFFUL ||
+        last.target % SECTOR_SIZE != 0 || IsInArea(last.target, SECTOR_SIZE))
+        return W25QXX_ERR_NONE; // nothing pending
+
+    err = ScratchCrc(&crc);
+    if (err != W25QXX_ERR_NONE)
+        return err;
+
+    // a torn record has a wrong CRC, the target wasn't touched then
+    if (crc != last.crc)
+        return W25QXX_ERR_NONE;
+
+    return CopyBack(last.target, slot - 1);
+}
+
+W25QXX_ErrorCode W25QXX_RMW_Write(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    W25QXX_ErrorCode err;
+    uint32_t sector, offset, n;
+
+    if (__slot == SLOT_INVALID || IsInArea(addr, len))
+        return W25QXX_ERR_FAILED;
+
+    if (W25QXX_IsProtected(addr, len))
+        return W25QXX_ERR_PROTECTED;
+
+    while (len > 0)
+    {
+        sector = addr - addr % SECTOR_SIZE;
+        offset = addr - sector;
+        n = SECTOR_SIZE - offset;
+        if (n > len)
+            n = len;
+
+        if (n == SECTOR_SIZE)
+        {
+            // nothing to keep
+            err = W25QXX_Erase(sector, W25QXX_ERASE_SECTOR);
+            if (err == W25QXX_ERR_NONE && W25QXX_ProgramBytes(addr, buf, n) == false)
+                err = W25QXX_ERR_FAILED;
+        }
+        else if (W25QXX_IsEmpty(addr, n))
+        {
+            err = W25QXX_ProgramBytes(addr, buf, n) ? W25QXX_ERR_NONE : W25QXX_ERR_FAILED;
+        }
+        else
+        {
+            err = Stage(sector, (uint16_t)offset, buf, (uint16_t)n);
+            if (err == W25QXX_ERR_NONE)
+                err = CopyBack(sector, __slot - 1);
+        }
+
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+
+    return W25QXX_ERR_NONE;
+}
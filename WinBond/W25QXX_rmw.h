@@ -0,0 +1,53 @@
+#ifndef _H_W25QXX_RMW
+#define _H_W25QXX_RMW
+
+#include "W25QXX.h"
+
+/**
+ * *****************************************************
+ *
+ * read-modify-write with a page sized RAM buffer
+ *
+ * 'W25QXX_WriteBytes()' erases the whole sector of a dirty range and loses
+ * the data around it. 'W25QXX_RMW_Write()' keeps it: the merged sector is
+ * staged page by page into a reserved scratch sector, then the target is
+ * erased and the scratch copied back, only 256 bytes of RAM are used.
+ *
+ * a record in the log sector after the scratch sector marks a staged
+ * update, 'W25QXX_RMW_Init()' completes an update which was interrupted
+ * after that point (power loss), before it the target is still intact.
+ *
+ * ranges which are already blank are programmed directly, whole sectors
+ * are erased and programmed without the scratch copy.
+ *
+ * the staged sector is checked with 'W25QXX_SUM_Crc32()', link
+ * "W25QXX_sum.c".
+ *
+ * settings at "W25QXX_conf.h":
+ *   W25QXX_RMW_SCRATCH  address of 2 reserved sectors (scratch + log),
+ *                       sector aligned, not used for anything else
+ *
+ * *****************************************************
+*/
+
+#ifndef W25QXX_RMW_SCRATCH
+#error "macro 'W25QXX_RMW_SCRATCH' must be defined"
+#endif
+
+#if (W25QXX_RMW_SCRATCH % W25QXX_SECTOR_SIZE) != 0
+#error "'W25QXX_RMW_SCRATCH' must be sector aligned"
+#endif
+
+#define W25QXX_RMW_AREA_SIZE (2 * W25QXX_SECTOR_SIZE)
+
+/**
+ * call once after 'W25QXX_Init()', completes an interrupted update
+*/
+W25QXX_ErrorCode W25QXX_RMW_Init(void);
+
+/**
+ * write [addr, addr + len), the rest of the sectors is kept
+*/
+W25QXX_ErrorCode W25QXX_RMW_Write(uint32_t addr, uint8_t *buf, uint32_t len);
+
+#endif
@@ -0,0 +1,220 @@
+#include "W25QXX_sched.h"
+#include <stddef.h>
+
+#define PAGE_SIZE W25QXX_PAGE_SIZE
+#define SECTOR_SIZE W25QXX_SECTOR_SIZE
+
+#undef true
+#define true 1
+
+#undef false
+#define false 0
+
+//------------------- internal func -------------------
+
+static W25QXX_SCHED_LockHook __lock = NULL;
+static W25QXX_SCHED_Request *__queue = NULL;
+static uint32_t __order = 0;
+
+// return true if 'a' should run before 'b'
+static uint8_t IsBefore(W25QXX_SCHED_Request *a, W25QXX_SCHED_Request *b)
+{
+    if (a->priority != b->priority)
+        return a->priority < b->priority;
+
+    if ((a->op == W25QXX_SCHED_READ) != (b->op == W25QXX_SCHED_READ))
+        return a->op == W25QXX_SCHED_READ;
+
+    return (int32_t)(a->order - b->order) < 0;
+}
+
+static W25QXX_SCHED_Request *PickNext(void)
+{
+    W25QXX_SCHED_Request *req, *best = __queue;
+
+    for (req = __queue; req != NULL; req = req->next)
+    {
+        if (IsBefore(req, best))
+            best = req;
+    }
+
+    return best;
+}
+
+static void Complete(W25QXX_SCHED_Request *req, W25QXX_ErrorCode result)
+{
+    W25QXX_SCHED_Request **p = &__queue;
+
+    while (*p != req)
+        p = &(*p)->next;
+
+    *p = req->next;
+    req->next = NULL;
+    req->result = result;
+    req->state = W25QXX_SCHED_DONE;
+}
+
+static uint32_t Min(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+// run one chunk of a request, return true when the request is finished
+static uint8_t RunChunk(W25QXX_SCHED_Request *req, W25QXX_ErrorCode *err)
+{
+    uint32_t addr = req->addr + req->done;
+    uint32_t remain = req->len - req->done;
+    uint32_t n;
+
+    *err = W25QXX_ERR_NONE;
+
+    if (remain == 0)
+        return true;
+
+    switch (req->op)
+    {
+    case W25QXX_SCHED_READ:
+        n = Min(remain, W25QXX_SCHED_READ_CHUNK);
+        *err = W25QXX_ReadBytes(addr, req->buf + req->done, n);
+        break;
+    case W25QXX_SCHED_WRITE:
+        // the blank check covers the whole part of the sector we write,
+        // the same as 'W25QXX_WriteBytes()'
+        if (!req->checked)
+        {
+            n = Min(remain, SECTOR_SIZE - addr % SECTOR_SIZE);
+            if (!W25QXX_IsEmpty(addr, n))
+                *err = W25QXX_Erase(addr, W25QXX_ERASE_SECTOR);
+            req->checked = true;
+            return *err != W25QXX_ERR_NONE;
+        }
+        // fall through
+    case W25QXX_SCHED_PROGRAM:
+        n = Min(remain, PAGE_SIZE - addr % PAGE_SIZE);
+        if (W25QXX_ProgramBytes(addr, req->buf + req->done, n) == false)
+            *err = W25QXX_ERR_FAILED;
+        if ((addr + n) % SECTOR_SIZE == 0)
+            req->checked = false;
+        break;
+    case W25QXX_SCHED_ERASE:
+        n = Min(remain, SECTOR_SIZE - addr % SECTOR_SIZE);
+        *err = W25QXX_Erase(addr, W25QXX_ERASE_SECTOR);
+        break;
+    default:
+        *err = W25QXX_ERR_FAILED;
+        return true;
+    }
+
+    req->done += n;
+
+    return *err != W25QXX_ERR_NONE || req->done == req->len;
+}
+
+// run one chunk of the most urgent request, lock must be held
+static uint8_t Step(void)
+{
+    W25QXX_SCHED_Request *req = PickNext();
+    W25QXX_ErrorCode err;
+
+    if (req == NULL)
+        return false;
+
+    if (RunChunk(req, &err))
+        Complete(req, err);
+
+    return true;
+}
+
+//-----------------------------------------------
+
+void W25QXX_SCHED_Init(W25QXX_SCHED_LockHook lockHook)
+{
+    __lock = lockHook;
+    __queue = NULL;
+    __order = 0;
+}
+
+void W25QXX_SCHED_Lock(void)
+{
+    if (__lock)
+        __lock(true);
+}
+
+void W25QXX_SCHED_Unlock(void)
+{
+    if (__lock)
+        __lock(false);
+}
+
+void W25QXX_SCHED_Submit(W25QXX_SCHED_Request *req)
+{
+    req->state = W25QXX_SCHED_PENDING;
+    req->result = W25QXX_ERR_NONE;
+    req->done = 0;
+    req->checked = false;
+
+    W25QXX_SCHED_Lock();
+    req->order = __order++;
+    req->next = __queue;
+    __queue = req;
+    W25QXX_SCHED_Unlock();
+}
+
+uint8_t W25QXX_SCHED_Poll(void)
+{
+    uint8_t busy;
+
+    W25QXX_SCHED_Lock();
+    busy = Step();
+    W25QXX_SCHED_Unlock();
+
+    return busy;
+}
+
+W25QXX_ErrorCode W25QXX_SCHED_Run(W25QXX_SCHED_Request *req)
+{
+    W25QXX_SCHED_Submit(req);
+
+    // the lock is given back after every chunk so other tasks get their turn
+    while (1)
+    {
+        W25QXX_SCHED_Lock();
+
+        if (req->state == W25QXX_SCHED_DONE)
+        {
+            W25QXX_SCHED_Unlock();
+            return req->result;
+        }
+
+        Step();
+        W25QXX_SCHED_Unlock();
+    }
+}
+
+static W25QXX_ErrorCode RunOp(W25QXX_SCHED_Op op, uint32_t addr, uint8_t *buf, uint32_t len, uint8_t priority)
+{
+    W25QXX_SCHED_Request req;
+
+    req.op = op;
+    req.priority = priority;
+    req.addr = addr;
+    req.buf = buf;
+    req.len = len;
+
+    return W25QXX_SCHED_Run(&req);
+}
+
+W25QXX_ErrorCode W25QXX_SCHED_Read(uint32_t addr, uint8_t *buf, uint32_t len, uint8_t priority)
+{
+    return RunOp(W25QXX_SCHED_READ, addr, buf, len, priority);
+}
+
+W25QXX_ErrorCode W25QXX_SCHED_Write(uint32_t addr, uint8_t *buf, uint32_t len, uint8_t priority)
+{
+    return RunOp(W25QXX_SCHED_WRITE, addr, buf, len, priority);
+}
+
+W25QXX_ErrorCode W25QXX_SCHED_Erase(uint32_t addr, uint32_t len, uint8_t priority)
+{
+    return RunOp(W25QXX_SCHED_ERASE, addr, NULL, len, priority);
+}
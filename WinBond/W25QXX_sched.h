@@ -0,0 +1,103 @@
+#ifndef _H_W25QXX_SCHED
+#define _H_W25QXX_SCHED
+
+#include "W25QXX.h"
+
+/**
+ * *****************************************************
+ *
+ * request scheduler for several tasks sharing one chip
+ *
+ * tasks queue requests instead of calling the driver. the queue is run one
+ * chunk at a time by whichever task is waiting, so an urgent read only
+ * waits for the chunk in progress, not for the whole bulk write:
+ *   read    split every 'W25QXX_SCHED_READ_CHUNK' bytes
+ *   write   blank check/erase per sector, then one page per chunk
+ *   program one page per chunk
+ *   erase   one sector per chunk
+ *
+ * the next chunk is taken from the pending request with the lowest
+ * priority value, reads first on a tie, then in submit order.
+ *
+ * the lock hook is called with 1 to take and 0 to give a mutex, it guards
+ * the queue and the chip. other code using the driver directly must do
+ * it between 'W25QXX_SCHED_Lock()' and 'W25QXX_SCHED_Unlock()'
+ *
+ * optional settings at "W25QXX_conf.h":
+ *   W25QXX_SCHED_READ_CHUNK  max bytes read per chunk
+ *
+ * *****************************************************
+*/
+
+#ifndef W25QXX_SCHED_READ_CHUNK
+#define W25QXX_SCHED_READ_CHUNK W25QXX_SECTOR_SIZE
+#endif
+
+typedef void (*W25QXX_SCHED_LockHook)(uint8_t lock);
+
+typedef enum
+{
+    W25QXX_SCHED_READ = 0,
+    W25QXX_SCHED_WRITE,   // like 'W25QXX_WriteBytes()'
+    W25QXX_SCHED_PROGRAM, // like 'W25QXX_ProgramBytes()'
+    W25QXX_SCHED_ERASE    // erase all sectors in [addr, addr + len)
+} W25QXX_SCHED_Op;
+
+typedef enum
+{
+    W25QXX_SCHED_IDLE = 0,
+    W25QXX_SCHED_PENDING,
+    W25QXX_SCHED_DONE
+} W25QXX_SCHED_State;
+
+typedef struct W25QXX_SCHED_Request
+{
+    W25QXX_SCHED_Op op;
+    uint8_t priority; // 0: most urgent
+    uint32_t addr;
+    uint8_t *buf;
+    uint32_t len;
+
+    // set by the scheduler
+    volatile W25QXX_SCHED_State state;
+    W25QXX_ErrorCode result;
+    uint32_t done;   // bytes processed
+    uint8_t checked; // write: current sector is blank
+    uint32_t order;
+    struct W25QXX_SCHED_Request *next;
+} W25QXX_SCHED_Request;
+
+void W25QXX_SCHED_Init(W25QXX_SCHED_LockHook lockHook);
+
+/**
+ * queue a request, the request must stay valid until it's done
+*/
+void W25QXX_SCHED_Submit(W25QXX_SCHED_Request *req);
+
+/**
+ * run one chunk of the queue
+ * return false if the queue is empty
+*/
+uint8_t W25QXX_SCHED_Poll(void);
+
+/**
+ * queue a request and run the queue until it's done
+*/
+W25QXX_ErrorCode W25QXX_SCHED_Run(W25QXX_SCHED_Request *req);
+
+/**
+ * blocking helpers built on 'W25QXX_SCHED_Run()'
+*/
+
+W25QXX_ErrorCode W25QXX_SCHED_Read(uint32_t addr, uint8_t *buf, uint32_t len, uint8_t priority);
+W25QXX_ErrorCode W25QXX_SCHED_Write(uint32_t addr, uint8_t *buf, uint32_t len, uint8_t priority);
+W25QXX_ErrorCode W25QXX_SCHED_Erase(uint32_t addr, uint32_t len, uint8_t priority);
+
+/**
+ * direct driver access
+*/
+
+void W25QXX_SCHED_Lock(void);
+void W25QXX_SCHED_Unlock(void);
+
+#endif
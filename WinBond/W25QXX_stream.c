@@ -0,0 +1,134 @@
+#include "W25QXX_stream.h"
+#include <string.h>
+
+// read-ahead state
+#define STATE_IDLE 0    // no transaction, nothing read ahead
+#define STATE_RUNNING 1 // transaction open, the next chunk is being read
+#define STATE_AHEAD 2   // no transaction, the next chunk is ready
+
+//------------------- internal func -------------------
+
+static uint8_t *Chunk(W25QXX_STREAM_Reader *s, uint8_t index)
+{
+    return s->buf + (uint32_t)index * s->half;
+}
+
+// make the chunk read ahead the current one and start reading the next
+static W25QXX_ErrorCode Refill(W25QXX_STREAM_Reader *s)
+{
+    W25QXX_ErrorCode err;
+
+    switch (s->state)
+    {
+    case STATE_IDLE:
+        err = W25QXX_ReadBegin(s->fetch, Chunk(s, s->cur ^ 1), s->half);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+        s->fetch += s->half;
+        s->state = STATE_RUNNING;
+        // fall through
+    case STATE_RUNNING:
+        // the consumed chunk takes the next read
+        err = W25QXX_ReadContinue(Chunk(s, s->cur), s->half);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+        break;
+    default: // STATE_AHEAD
+        err = W25QXX_ReadBegin(s->fetch, Chunk(s, s->cur), s->half);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+        s->state = STATE_RUNNING;
+        break;
+    }
+
+    s->cur ^= 1;
+    s->start = s->fetch - s->half;
+    s->fetch += s->half;
+    s->ready = s->half;
+    s->offset = 0;
+
+    return W25QXX_ERR_NONE;
+}
+
+//-----------------------------------------------
+
+W25QXX_ErrorCode W25QXX_STREAM_Open(W25QXX_STREAM_Reader *s, uint32_t addr, uint8_t *buf, uint32_t size)
+{
+    // an empty chunk would never advance
+    if (size < 4)
+        return W25QXX_ERR_FAILED;
+
+    s->buf = buf;
+    s->half = (uint16_t)((size / 2 > 0xFFFF ? 0xFFFF : size / 2) & ~1U); // even
+    s->cur = 0;
+    s->state = STATE_IDLE;
+    s->ready = 0;
+    s->offset = 0;
+    s->start = addr;
+    s->fetch = addr;
+
+    return W25QXX_ERR_NONE;
+}
+
+W25QXX_ErrorCode W25QXX_STREAM_Read(W25QXX_STREAM_Reader *s, uint8_t *buf, uint32_t len)
+{
+    W25QXX_ErrorCode err;
+    uint32_t n;
+
+    while (len > 0)
+    {
+        if (s->offset == s->ready)
+        {
+            err = Refill(s);
+            if (err != W25QXX_ERR_NONE)
+                return err;
+        }
+
+        n = s->ready - s->offset;
+        if (n > len)
+            n = len;
+
+        memcpy(buf, Chunk(s, s->cur) + s->offset, n);
+        s->offset += n;
+        buf += n;
+        len -= n;
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+void W25QXX_STREAM_Seek(W25QXX_STREAM_Reader *s, uint32_t addr)
+{
+    // inside the current chunk, nothing to read
+    if (s->ready && addr >= s->start && addr - s->start < s->ready)
+    {
+        s->offset = (uint16_t)(addr - s->start);
+        return;
+    }
+
+    W25QXX_STREAM_Close(s);
+    s->ready = 0;
+    s->offset = 0;
+    s->start = addr;
+    s->fetch = addr;
+}
+
+uint32_t W25QXX_STREAM_Tell(W25QXX_STREAM_Reader *s)
+{
+    return s->start + s->offset;
+}
+
+void W25QXX_STREAM_Pause(W25QXX_STREAM_Reader *s)
+{
+    if (s->state == STATE_RUNNING)
+    {
+        W25QXX_ReadEnd();
+        s->state = STATE_AHEAD;
+    }
+}
+
+void W25QXX_STREAM_Close(W25QXX_STREAM_Reader *s)
+{
+    W25QXX_STREAM_Pause(s);
+    s->state = STATE_IDLE;
+}
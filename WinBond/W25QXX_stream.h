@@ -0,0 +1,54 @@
+#ifndef _H_W25QXX_STREAM
+#define _H_W25QXX_STREAM
+
+#include "W25QXX.h"
+
+/**
+ * *****************************************************
+ *
+ * sequential stream reader with read-ahead
+ *
+ * the buffer given to 'W25QXX_STREAM_Open()' is split in two halves, the
+ * consumer reads from one while the next chunk is read into the other.
+ * with a bulk hook ('W25QXX_SetBulkHook()') the read-ahead runs in the
+ * background, without it the next chunk is read when the current one is
+ * used up.
+ *
+ * the read transaction is kept open between chunks (CS low), so opcode
+ * and address are only sent once. the bus is busy until
+ * 'W25QXX_STREAM_Pause()' or 'W25QXX_STREAM_Close()', call one of them
+ * before any other call to the driver ('W25QXX_PowerPoll()' too).
+ * a paused stream keeps the chunk read ahead.
+ *
+ *   W25QXX_STREAM_Open(&s, addr, buf, sizeof(buf));
+ *   while (playing)
+ *       W25QXX_STREAM_Read(&s, frame, sizeof(frame));
+ *   W25QXX_STREAM_Close(&s);
+ *
+ * *****************************************************
+*/
+
+typedef struct
+{
+    uint8_t *buf;
+    uint16_t half;   // bytes per chunk
+    uint8_t cur;     // index of the chunk being consumed
+    uint8_t state;   // read-ahead state
+    uint16_t ready;  // bytes in the current chunk, 0 or 'half'
+    uint16_t offset; // bytes consumed from the current chunk
+    uint32_t start;  // flash address of the current chunk
+    uint32_t fetch;  // flash address of the next chunk to read
+} W25QXX_STREAM_Reader;
+
+/**
+ * 'size' is the read-ahead buffer size, two chunks of an even size,
+ * W25QXX_ERR_FAILED below 4 bytes
+*/
+W25QXX_ErrorCode W25QXX_STREAM_Open(W25QXX_STREAM_Reader *s, uint32_t addr, uint8_t *buf, uint32_t size);
+W25QXX_ErrorCode W25QXX_STREAM_Read(W25QXX_STREAM_Reader *s, uint8_t *buf, uint32_t len);
+void W25QXX_STREAM_Seek(W25QXX_STREAM_Reader *s, uint32_t addr);
+uint32_t W25QXX_STREAM_Tell(W25QXX_STREAM_Reader *s); // flash address of the next byte
+void W25QXX_STREAM_Pause(W25QXX_STREAM_Reader *s);   // free the bus, keep the read-ahead
+void W25QXX_STREAM_Close(W25QXX_STREAM_Reader *s);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef _H_W25QXX_SUM
+#define _H_W25QXX_SUM
+
+#include "W25QXX.h"
+
+/**
+ * *****************************************************
+ *
+ * checksum of a flash region
+ *
+ * the region is read in chunks of 'W25QXX_SUM_CHUNK_SIZE' bytes into two
+ * buffers, with a bulk hook installed ('W25QXX_SetBulkHook()') the next
+ * chunk is read while the current one is being summed.
+ *
+ *   CRC32   IEEE 802.3, slice-by-8 (8KB of tables in ROM)
+ *   CRC16   CCITT-FALSE (poly 0x1021, init 0xFFFF)
+ *   SHA256  only with 'W25QXX_SUM_USE_SHA256' defined
+ *
+ * optional settings at "W25QXX_conf.h":
+ *   W25QXX_SUM_CHUNK_SIZE  bytes per read, 2x in RAM
+ *   W25QXX_SUM_USE_SHA256  enable SHA-256
+ *
+ * *****************************************************
+*/
+
+#ifndef W25QXX_SUM_CHUNK_SIZE
+#define W25QXX_SUM_CHUNK_SIZE 512
+#endif
+
+#if (W25QXX_SUM_CHUNK_SIZE % 8) != 0
+#error "'W25QXX_SUM_CHUNK_SIZE' must be a multiple of 8"
+#endif
+
+typedef enum
+{
+    W25QXX_SUM_CRC32 = 0, // 4 byte digest, little endian
+    W25QXX_SUM_CRC16,     // 2 byte digest, little endian
+    W25QXX_SUM_SHA256     // 32 byte digest, needs 'W25QXX_SUM_USE_SHA256'
+} W25QXX_SUM_Algo;
+
+/**
+ * checksum of [addr, addr + len)
+*/
+W25QXX_ErrorCode W25QXX_SUM_ChecksumRange(uint32_t addr, uint32_t len, W25QXX_SUM_Algo algo, uint8_t *digest);
+
+/**
+ * incremental checksums of RAM data
+ * start with crc = 0 for CRC32 and crc = 0xFFFF for CRC16
+*/
+
+uint32_t W25QXX_SUM_Crc32(uint32_t crc, const uint8_t *buf, uint32_t len);
+uint16_t W25QXX_SUM_Crc16(uint16_t crc, const uint8_t *buf, uint32_t len);
+
+#ifdef W25QXX_SUM_USE_SHA256
+
+typedef struct
+{
+    uint32_t state[8];
+    uint32_t count; // bytes hashed, images are less than 4GB
+    uint8_t block[64];
+} W25QXX_SUM_Sha256;
+
+void W25QXX_SUM_Sha256Init(W25QXX_SUM_Sha256 *ctx);
+void W25QXX_SUM_Sha256Update(W25QXX_SUM_Sha256 *ctx, const uint8_t *buf, uint32_t len);
+void W25QXX_SUM_Sha256Final(W25QXX_SUM_Sha256 *ctx, uint8_t *digest);
+
+#endif
+
+#endif
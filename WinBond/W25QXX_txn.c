@@ -0,0 +1,598 @@
+#include "W25QXX_txn.h"
+#include "W25QXX_sum.h"
+
+#define PAGE_SIZE W25QXX_PAGE_SIZE
+#define SECTOR_SIZE W25QXX_SECTOR_SIZE
+
+#undef true
+#define true 1
+
+#undef false
+#define false 0
+
+#define DESC_ADDR W25QXX_TXN_JOURNAL
+#define DESC_NUM (SECTOR_SIZE / sizeof(Desc))
+#define IMAGE_ADDR(index) (W25QXX_TXN_JOURNAL + SECTOR_SIZE + (uint32_t)(index) * PAGE_SIZE)
+#define IMAGE_NUM ((W25QXX_TXN_JOURNAL_SIZE - SECTOR_SIZE) / PAGE_SIZE)
+#define SECTOR_PAGES (SECTOR_SIZE / PAGE_SIZE) // one bit each in a uint16_t mask
+
+// descriptor types
+#define TYPE_PAGE 0x5041   // new image of the 'target' page, 'crc' of the image
+#define TYPE_ERASE 0x4552  // erase the 'target' sector before the pages are copied
+#define TYPE_COMMIT 0x434D // 'crc' of the descriptors of the transaction before it
+#define TYPE_DONE 0x444E   // the transaction is in the targets
+
+// transaction state
+#define STATE_INVALID 0 // 'W25QXX_TXN_Init()' not called yet, or a commit is pending
+#define STATE_IDLE 1
+#define STATE_OPEN 2
+
+typedef struct
+{
+    uint16_t type;
+    uint16_t image; // image index of a page
+    uint32_t seq;   // transaction sequence number
+    uint32_t target;
+    uint32_t crc;
+} Desc;
+
+//------------------- internal func -------------------
+
+static uint8_t __page[PAGE_SIZE];
+static uint8_t __state = STATE_INVALID;
+static uint32_t __seq;       // sequence number of the open or last transaction
+static uint16_t __nextDesc;  // next free descriptor
+static uint16_t __nextImage; // next free image slot
+
+// pages of the open transaction, the latest image of each
+static uint32_t __pageAddr[W25QXX_TXN_MAX_PAGES];
+static uint16_t __pageImage[W25QXX_TXN_MAX_PAGES];
+static uint32_t __pageCrc[W25QXX_TXN_MAX_PAGES];
+static uint16_t __pages;
+
+// sectors of the open transaction, masks of their pages
+static uint32_t __sectorAddr[W25QXX_TXN_MAX_PAGES];
+static uint16_t __sectorPages[W25QXX_TXN_MAX_PAGES]; // in the transaction
+static uint16_t __sectorData[W25QXX_TXN_MAX_PAGES];  // not blank, read when an erase is needed
+static uint8_t __sectorErase[W25QXX_TXN_MAX_PAGES];
+static uint16_t __sectors;
+
+static uint8_t IsBlank(const uint8_t *buf, uint32_t len)
+{
+    while (len--)
+    {
+        if (*buf++ != 0xFF)
+            return false;
+    }
+
+    return true;
+}
+
+static uint8_t IsInJournal(uint32_t addr, uint32_t len)
+{
+    return addr < W25QXX_TXN_JOURNAL + W25QXX_TXN_JOURNAL_SIZE && W25QXX_TXN_JOURNAL < addr + len;
+}
+
+static uint8_t PopCount(uint16_t mask)
+{
+    uint8_t n = 0;
+
+    for (; mask; mask &= mask - 1)
+        n++;
+
+    return n;
+}
+
+static int16_t FindPage(uint32_t page)
+{
+    uint16_t i;
+
+    for (i = 0; i < __pages; i++)
+    {
+        if (__pageAddr[i] == page)
+            return (int16_t)i;
+    }
+
+    return -1;
+}
+
+static int16_t FindSector(uint32_t sector)
+{
+    uint16_t i;
+
+    for (i = 0; i < __sectors; i++)
+    {
+        if (__sectorAddr[i] == sector)
+            return (int16_t)i;
+    }
+
+    return -1;
+}
+
+// pages saved by the commit for the sectors it erases
+static uint16_t SavedPages(void)
+{
+    uint16_t i, n = 0;
+
+    for (i = 0; i < __sectors; i++)
+    {
+        if (__sectorErase[i])
+            n += PopCount(__sectorData[i] & ~__sectorPages[i]);
+    }
+
+    return n;
+}
+
+static uint16_t ErasedSectors(void)
+{
+    uint16_t i, n = 0;
+
+    for (i = 0; i < __sectors; i++)
+        n += __sectorErase[i];
+
+    return n;
+}
+
+static W25QXX_ErrorCode ReadDesc(uint16_t slot, Desc *desc)
+{
+    return W25QXX_ReadBytes(DESC_ADDR + slot * sizeof(Desc), (uint8_t *)desc, sizeof(Desc));
+}
+
+static W25QXX_ErrorCode AppendDesc(uint16_t type, uint16_t image, uint32_t seq, uint32_t target, uint32_t crc)
+{
+    Desc desc;
+
+    if (__nextDesc >= DESC_NUM)
+        return W25QXX_ERR_FAILED;
+
+    desc.type = type;
+    desc.image = image;
+    desc.seq = seq;
+    desc.target = target;
+    desc.crc = crc;
+
+    // a failed descriptor is skipped, it may be half programmed
+    __nextDesc++;
+
+    if (W25QXX_ProgramBytes(DESC_ADDR + (__nextDesc - 1) * sizeof(Desc), (uint8_t *)&desc, sizeof(desc)) == false)
+        return W25QXX_ERR_FAILED;
+
+    return W25QXX_ERR_NONE;
+}
+
+// CRC32 of the descriptors of transaction 'seq' in [0, end)
+static W25QXX_ErrorCode SeqCrc(uint32_t seq, uint16_t end, uint32_t *crc)
+{
+    W25QXX_ErrorCode err;
+    Desc desc;
+    uint16_t slot;
+
+    *crc = 0;
+
+    for (slot = 0; slot < end; slot++)
+    {
+        err = ReadDesc(slot, &desc);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        if (desc.seq == seq)
+            *crc = W25QXX_SUM_Crc32(*crc, (uint8_t *)&desc, sizeof(desc));
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+// the image in '__page' has a bit which the target page must get back to 1
+static W25QXX_ErrorCode NeedsErase(uint32_t page, uint8_t *erase)
+{
+    W25QXX_ErrorCode err;
+    uint8_t chunk[32];
+    uint16_t offset, i;
+
+    *erase = false;
+
+    for (offset = 0; offset < PAGE_SIZE && *erase == false; offset += sizeof(chunk))
+    {
+        err = W25QXX_ReadBytes(page + offset, chunk, sizeof(chunk));
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        for (i = 0; i < sizeof(chunk); i++)
+        {
+            if (__page[offset + i] & ~chunk[i])
+            {
+                *erase = true;
+                break;
+            }
+        }
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+// the commit erases the sector, find the pages it has to save
+static void MarkErase(uint16_t index)
+{
+    uint16_t i;
+
+    __sectorErase[index] = true;
+    __sectorData[index] = 0;
+
+    for (i = 0; i < SECTOR_PAGES; i++)
+    {
+        if (W25QXX_IsEmpty(__sectorAddr[index] + i * PAGE_SIZE, PAGE_SIZE) == false)
+            __sectorData[index] |= (uint16_t)(1U << i);
+    }
+}
+
+// log the erase of a sector, save its pages which aren't in the transaction
+static W25QXX_ErrorCode JournalErase(uint16_t index)
+{
+    W25QXX_ErrorCode err;
+    uint16_t save = __sectorData[index] & ~__sectorPages[index], i;
+    uint32_t page;
+
+    err = AppendDesc(TYPE_ERASE, 0, __seq, __sectorAddr[index], 0);
+    if (err != W25QXX_ERR_NONE)
+        return err;
+
+    for (i = 0; i < SECTOR_PAGES; i++)
+    {
+        if ((save & (1U << i)) == 0)
+            continue;
+
+        page = __sectorAddr[index] + i * PAGE_SIZE;
+
+        if (__nextImage >= IMAGE_NUM) // counted by 'W25QXX_TXN_Write()', can't happen
+            return W25QXX_ERR_FAILED;
+
+        err = W25QXX_ReadBytes(page, __page, PAGE_SIZE);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        if (W25QXX_ProgramBytes(IMAGE_ADDR(__nextImage), __page, PAGE_SIZE) == false)
+            return W25QXX_ERR_FAILED;
+
+        err = AppendDesc(TYPE_PAGE, __nextImage++, __seq, page, W25QXX_SUM_Crc32(0, __page, PAGE_SIZE));
+        if (err != W25QXX_ERR_NONE)
+            return err;
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+// copy transaction 'seq' to the targets, it can be repeated
+static W25QXX_ErrorCode Apply(uint32_t seq, uint16_t end)
+{
+    W25QXX_ErrorCode err;
+    Desc desc;
+    uint16_t slot;
+
+    for (slot = 0; slot < end; slot++)
+    {
+        err = ReadDesc(slot, &desc);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        if (desc.type == TYPE_ERASE && desc.seq == seq)
+        {
+            err = W25QXX_Erase(desc.target, W25QXX_ERASE_SECTOR);
+            if (err != W25QXX_ERR_NONE)
+                return err;
+        }
+    }
+
+    for (slot = 0; slot < end; slot++)
+    {
+        err = ReadDesc(slot, &desc);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        if (desc.type != TYPE_PAGE || desc.seq != seq)
+            continue;
+
+        err = W25QXX_ReadBytes(IMAGE_ADDR(desc.image), __page, PAGE_SIZE);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        if (W25QXX_SUM_Crc32(0, __page, PAGE_SIZE) != desc.crc)
+            return W25QXX_ERR_FAILED;
+
+        // a page left unchanged or already copied programs the same bits again
+        if (IsBlank(__page, PAGE_SIZE) == false &&
+            W25QXX_ProgramBytes(desc.target, __page, PAGE_SIZE) == false)
+            return W25QXX_ERR_FAILED;
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+// journal the page with [offset, offset + len) replaced
+static W25QXX_ErrorCode WritePage(uint32_t page, uint16_t offset, uint8_t *buf, uint16_t len)
+{
+    W25QXX_ErrorCode err;
+    uint32_t sector = page - page % SECTOR_SIZE;
+    int16_t index, sec;
+    uint8_t inPlace = true, erase;
+    uint16_t image, i;
+
+    index = FindPage(page);
+    if (index < 0 && __pages >= W25QXX_TXN_MAX_PAGES)
+        return W25QXX_ERR_FAILED;
+
+    sec = FindSector(sector);
+    if (sec < 0) // fewer sectors than pages
+    {
+        sec = (int16_t)__sectors++;
+        __sectorAddr[sec] = sector;
+        __sectorPages[sec] = 0;
+        __sectorErase[sec] = false;
+    }
+
+    // a page written before in this transaction goes on from its image
+    err = W25QXX_ReadBytes(index < 0 ? page : IMAGE_ADDR(__pageImage[index]), __page, PAGE_SIZE);
+    if (err != W25QXX_ERR_NONE)
+        return err;
+
+    for (i = 0; i < len; i++)
+    {
+        if (buf[i] & ~__page[offset + i])
+            inPlace = false; // the image can't be programmed over the old one
+        __page[offset + i] = buf[i];
+    }
+
+    if (__sectorErase[sec] == false)
+    {
+        if (index < 0)
+            erase = inPlace == false; // the old image is the target
+        else if ((err = NeedsErase(page, &erase)) != W25QXX_ERR_NONE)
+            return err;
+
+        if (erase)
+            MarkErase((uint16_t)sec);
+    }
+
+    __sectorPages[sec] |= (uint16_t)(1U << (page % SECTOR_SIZE / PAGE_SIZE));
+    if (index < 0)
+        inPlace = false;
+
+    // the whole transaction has to fit, the commit can't fail for lack of room
+    if ((uint32_t)__nextImage + (inPlace ? 0 : 1) + SavedPages() > IMAGE_NUM ||
+        (uint32_t)__nextDesc + __pages + (index < 0 ? 1 : 0) + SavedPages() + ErasedSectors() + 2 > DESC_NUM)
+        return W25QXX_ERR_FAILED;
+
+    image = inPlace ? __pageImage[index] : __nextImage++;
+
+    if (IsBlank(__page, PAGE_SIZE) == false &&
+        W25QXX_ProgramBytes(IMAGE_ADDR(image), __page, PAGE_SIZE) == false)
+        return W25QXX_ERR_FAILED;
+
+    if (index < 0)
+    {
+        index = (int16_t)__pages++;
+        __pageAddr[index] = page;
+    }
+
+    __pageImage[index] = image;
+    __pageCrc[index] = W25QXX_SUM_Crc32(0, __page, PAGE_SIZE);
+
+    return W25QXX_ERR_NONE;
+}
+
+static W25QXX_ErrorCode EraseJournal(void)
+{
+    W25QXX_ErrorCode err;
+    uint32_t addr, end;
+
+    // the images first, the descriptors point into them until the end
+    end = IMAGE_ADDR(__nextImage);
+
+    for (addr = IMAGE_ADDR(0); addr < end; addr += SECTOR_SIZE)
+    {
+        err = W25QXX_Erase(addr, W25QXX_ERASE_SECTOR);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+    }
+
+    err = W25QXX_Erase(DESC_ADDR, W25QXX_ERASE_SECTOR);
+    if (err != W25QXX_ERR_NONE)
+        return err;
+
+    __nextDesc = 0;
+    __nextImage = 0;
+
+    return W25QXX_ERR_NONE;
+}
+
+//-----------------------------------------------
+
+W25QXX_ErrorCode W25QXX_TXN_Init(void)
+{
+    W25QXX_ErrorCode err;
+    Desc desc, commit = {0, 0, 0, 0, 0};
+    uint16_t slot, last = DESC_NUM;
+    uint8_t done = false;
+    uint32_t crc;
+
+    __state = STATE_INVALID;
+    __seq = 0;
+    __nextImage = 0;
+
+    // descriptors are appended, the first blank one is the end
+    for (slot = 0; slot < DESC_NUM; slot++)
+    {
+        err = ReadDesc(slot, &desc);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        if (IsBlank((uint8_t *)&desc, sizeof(desc)))
+            break;
+
+        // torn descriptors only have more bits set, these maxima stay safe
+        if ((int32_t)(desc.seq - __seq) > 0)
+            __seq = desc.seq;
+
+        if (desc.type != TYPE_ERASE && desc.type != TYPE_COMMIT && desc.type != TYPE_DONE &&
+            desc.image < IMAGE_NUM && desc.image >= __nextImage)
+            __nextImage = desc.image + 1;
+
+        if (desc.type == TYPE_COMMIT)
+        {
+            commit = desc;
+            last = slot;
+            done = false;
+        }
+        else if (desc.type == TYPE_DONE && last != DESC_NUM && desc.seq == commit.seq)
+        {
+            done = true;
+        }
+    }
+
+    __nextDesc = slot;
+
+    // images of a transaction cut before its commit have no descriptors
+    for (slot = IMAGE_NUM; slot > __nextImage; slot--)
+    {
+        if (W25QXX_IsEmpty(IMAGE_ADDR(slot - 1), PAGE_SIZE) == false)
+            break;
+    }
+
+    __nextImage = slot;
+
+    if (last != DESC_NUM && done == false)
+    {
+        // a torn commit record doesn't match, the transaction is dropped then
+        err = SeqCrc(commit.seq, last, &crc);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+
+        if (crc == commit.crc)
+        {
+            err = Apply(commit.seq, last);
+            if (err == W25QXX_ERR_NONE)
+                err = AppendDesc(TYPE_DONE, 0, commit.seq, 0, 0);
+            if (err != W25QXX_ERR_NONE)
+                return err;
+        }
+    }
+
+    __state = STATE_IDLE;
+
+    return W25QXX_ERR_NONE;
+}
+
+W25QXX_ErrorCode W25QXX_TXN_Begin(void)
+{
+    W25QXX_ErrorCode err;
+
+    if (__state != STATE_IDLE)
+        return W25QXX_ERR_FAILED;
+
+    // room for a transaction of 'W25QXX_TXN_MAX_PAGES' images
+    if (DESC_NUM - __nextDesc < 2 * W25QXX_TXN_MAX_PAGES + 2 ||
+        __nextImage > IMAGE_NUM - W25QXX_TXN_MAX_PAGES)
+    {
+        err = EraseJournal();
+        if (err != W25QXX_ERR_NONE)
+            return err;
+    }
+
+    __seq++;
+    __pages = 0;
+    __sectors = 0;
+    __state = STATE_OPEN;
+
+    return W25QXX_ERR_NONE;
+}
+
+W25QXX_ErrorCode W25QXX_TXN_Write(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    W25QXX_ErrorCode err;
+    uint32_t page, offset, n;
+
+    if (__state != STATE_OPEN || IsInJournal(addr, len))
+        return W25QXX_ERR_FAILED;
+
+    if (W25QXX_IsProtected(addr, len))
+        return W25QXX_ERR_PROTECTED;
+
+    while (len > 0)
+    {
+        page = addr - addr % PAGE_SIZE;
+        offset = addr - page;
+        n = PAGE_SIZE - offset;
+        if (n > len)
+            n = len;
+
+        err = WritePage(page, (uint16_t)offset, buf, (uint16_t)n);
+        if (err != W25QXX_ERR_NONE)
+        {
+            __state = STATE_IDLE; // the journal may be half written, drop it
+            return err;
+        }
+
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+
+    return W25QXX_ERR_NONE;
+}
+
+W25QXX_ErrorCode W25QXX_TXN_Commit(void)
+{
+    W25QXX_ErrorCode err;
+    uint32_t crc;
+    uint16_t i, last;
+
+    if (__state != STATE_OPEN)
+        return W25QXX_ERR_FAILED;
+
+    // dropped on error until the commit record is written
+    __state = STATE_IDLE;
+
+    for (i = 0; i < __pages; i++)
+    {
+        err = AppendDesc(TYPE_PAGE, __pageImage[i], __seq, __pageAddr[i], __pageCrc[i]);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+    }
+
+    // pages which only clear bits are programmed over the old data
+    for (i = 0; i < __sectors; i++)
+    {
+        if (__sectorErase[i] == false)
+            continue;
+
+        err = JournalErase(i);
+        if (err != W25QXX_ERR_NONE)
+            return err;
+    }
+
+    last = __nextDesc;
+
+    err = SeqCrc(__seq, last, &crc);
+    if (err != W25QXX_ERR_NONE)
+        return err;
+
+    // from here on 'W25QXX_TXN_Init()' decides, a written commit record is completed
+    __state = STATE_INVALID;
+
+    err = AppendDesc(TYPE_COMMIT, 0, __seq, 0, crc);
+    if (err == W25QXX_ERR_NONE)
+        err = Apply(__seq, last);
+    if (err == W25QXX_ERR_NONE)
+        err = AppendDesc(TYPE_DONE, 0, __seq, 0, 0);
+    if (err != W25QXX_ERR_NONE)
+        return err;
+
+    __state = STATE_IDLE;
+
+    return W25QXX_ERR_NONE;
+}
+
+void W25QXX_TXN_Abort(void)
+{
+    if (__state == STATE_OPEN)
+        __state = STATE_IDLE;
+}
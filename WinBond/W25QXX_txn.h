@@ -0,0 +1,107 @@
+#ifndef _H_W25QXX_TXN
+#define _H_W25QXX_TXN
+
+#include "W25QXX.h"
+
+/**
+ * *****************************************************
+ *
+ * power-fail-safe transactions with a write-ahead journal
+ *
+ * the writes of a transaction may span several sectors, after a reset
+ * either all of them are in the flash or none. 'W25QXX_TXN_Write()' puts
+ * the new image of each touched page into the journal, the target is not
+ * touched before 'W25QXX_TXN_Commit()'. writing a page again programs its
+ * image in place when only bits going from 1 to 0 change, else it takes
+ * another image.
+ *
+ * the commit only erases the sectors where a page needs a bit going from
+ * 0 to 1, the other pages are programmed over the old data. the rest of
+ * an erased sector is saved into the journal first. then a commit record
+ * (CRC32 of the transaction's descriptors, checked with
+ * 'W25QXX_SUM_Crc32()', link "W25QXX_sum.c") is written and the pages are
+ * copied to the targets. 'W25QXX_TXN_Init()' completes a commit which
+ * was cut by power loss, a transaction without commit record is dropped.
+ *
+ * the journal is one sector of 16 byte descriptors followed by page
+ * images, it's appended to and only erased by 'W25QXX_TXN_Begin()' when
+ * it has no room left for a transaction of 'W25QXX_TXN_MAX_PAGES' images.
+ *
+ * a transaction takes one image per page written, one more each time a
+ * page is written again with a bit going from 0 to 1, and one per page
+ * with data saved from the sectors to erase: a sector to erase costs up to
+ * 16 images, whichever of its pages are written. 'W25QXX_TXN_Write()'
+ * counts these and fails when the journal can't hold the transaction, the
+ * commit doesn't run out of room. e.g. 4 writes of 300 bytes over old
+ * data touch up to 8 sectors, up to 128 images.
+ *
+ * reads within a transaction see the old data.
+ *
+ * settings at "W25QXX_conf.h":
+ *   W25QXX_TXN_JOURNAL       address of the journal, sector aligned
+ *   W25QXX_TXN_JOURNAL_SIZE  journal size, default 4 sectors (48 images)
+ *   W25QXX_TXN_MAX_PAGES     images of a transaction which always fit,
+ *                            also the max. pages written, default 32,
+ *                            at most 127
+ *
+ *   W25QXX_TXN_Begin();
+ *   W25QXX_TXN_Write(CFG_ADDR, (uint8_t *)&cfg, sizeof(cfg));
+ *   W25QXX_TXN_Write(TABLE_ADDR, table, sizeof(table));
+ *   W25QXX_TXN_Commit();
+ *
+ * *****************************************************
+*/
+
+#ifndef W25QXX_TXN_JOURNAL
+#error "macro 'W25QXX_TXN_JOURNAL' must be defined"
+#endif
+
+#ifndef W25QXX_TXN_JOURNAL_SIZE
+#define W25QXX_TXN_JOURNAL_SIZE (4 * W25QXX_SECTOR_SIZE)
+#endif
+
+#ifndef W25QXX_TXN_MAX_PAGES
+#define W25QXX_TXN_MAX_PAGES 32
+#endif
+
+#if (W25QXX_TXN_JOURNAL % W25QXX_SECTOR_SIZE) != 0 || (W25QXX_TXN_JOURNAL_SIZE % W25QXX_SECTOR_SIZE) != 0
+#error "'W25QXX_TXN_JOURNAL' and 'W25QXX_TXN_JOURNAL_SIZE' must be sector aligned"
+#endif
+
+// one descriptor per image and erased sector, plus commit and done
+#if (2 * W25QXX_TXN_MAX_PAGES + 2) > (W25QXX_SECTOR_SIZE / 16)
+#error "'W25QXX_TXN_MAX_PAGES' is too large for the descriptor sector"
+#endif
+
+#if W25QXX_TXN_MAX_PAGES > ((W25QXX_TXN_JOURNAL_SIZE - W25QXX_SECTOR_SIZE) / W25QXX_PAGE_SIZE)
+#error "'W25QXX_TXN_JOURNAL_SIZE' is too small for 'W25QXX_TXN_MAX_PAGES'"
+#endif
+
+/**
+ * call once after 'W25QXX_Init()', completes an interrupted commit
+*/
+W25QXX_ErrorCode W25QXX_TXN_Init(void);
+
+W25QXX_ErrorCode W25QXX_TXN_Begin(void);
+
+/**
+ * add [addr, addr + len) to the transaction, the rest of the pages is kept.
+ * on error the transaction is dropped, e.g. when it has more than
+ * 'W25QXX_TXN_MAX_PAGES' pages or its images don't fit the journal
+*/
+W25QXX_ErrorCode W25QXX_TXN_Write(uint32_t addr, uint8_t *buf, uint32_t len);
+
+/**
+ * the data is in the flash when it returns W25QXX_ERR_NONE.
+ * an error before the commit record drops the transaction, after it
+ * 'W25QXX_TXN_Begin()' fails until 'W25QXX_TXN_Init()' is called again,
+ * which completes it
+*/
+W25QXX_ErrorCode W25QXX_TXN_Commit(void);
+
+/**
+ * drop the open transaction, nothing has been written to the targets
+*/
+void W25QXX_TXN_Abort(void);
+
+#endif
@@ -0,0 +1,355 @@
+/**
+ * *****************************************************
+ *
+ * driver benchmark on the flash model
+ *
+ * built once per driver (see Makefile), runs a fixed set of workloads
+ * and prints one JSON object per workload:
+ *
+ *   mbps          payload bytes / virtual time, MB/s (SPI clock and
+ *                 typical busy times of the model)
+ *   spi_per_byte  bytes on the bus per payload byte
+ *   programs      page programs
+ *   erases        sector + block erases
+ *   cpu_ns        host CPU time in the driver per payload byte: the
+ *                 workload runs a second time with the recorded bus
+ *                 bytes replayed by a trivial SPI hook instead of the
+ *                 model, the hook and the CS calls are counted in
+ *
+ * usage: bench_w25qxx [spi clock, Hz]
+ *
+ * *****************************************************
+*/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flash_emu.h"
+
+#if defined(BENCH_BY25DXX)
+
+#include "BY25DXX.h"
+#define DRIVER "BY25DXX"
+#define PART FlashEmu_BY25D40
+#define DRV_Init(hook) (BY25DXX_Init(hook) == BY25DXX_ERR_NONE)
+#define DRV_ReadBytes(a, b, n) BY25DXX_ReadBytes(a, b, n)
+#define DRV_WriteBytes(a, b, n) (BY25DXX_WriteBytes(a, b, n) == BY25DXX_ERR_NONE)
+#define DRV_WriteByte(a, d) (BY25DXX_WriteByte(a, d) == BY25DXX_ERR_NONE)
+#define DRV_WriteWord(a, w) (BY25DXX_WriteWord(a, w) == BY25DXX_ERR_NONE)
+#define DRV_Erase(a, t) BY25DXX_Erase(a, t)
+#define DRV_WaitReady() BY25DXX_WaitReady()
+#define ERASE_SECTOR BY25DXX_ERASE_SECTOR
+#define ERASE_BLOCK BY25DXX_ERASE_BLOCK
+
+#else
+
+#include "W25QXX.h"
+#define DRIVER "W25QXX"
+#define PART FlashEmu_W25Q64
+#define DRV_Init(hook) (W25QXX_Init(hook) == W25QXX_ERR_NONE)
+#define DRV_ReadBytes(a, b, n) W25QXX_ReadBytes(a, b, n)
+#define DRV_WriteBytes(a, b, n) W25QXX_WriteBytes(a, b, n)
+#define DRV_WriteByte(a, d) W25QXX_WriteByte(a, d)
+#define DRV_WriteWord(a, w) W25QXX_WriteWord(a, w)
+#define DRV_Erase(a, t) W25QXX_Erase(a, t)
+#define DRV_WaitReady() W25QXX_WaitReady()
+#define ERASE_SECTOR W25QXX_ERASE_SECTOR
+#define ERASE_BLOCK W25QXX_ERASE_BLOCK
+
+#endif
+
+#define REGION 0x40000UL // 256KB, fits the smallest part
+
+static uint8_t __data[REGION];
+static uint8_t __buf[4096];
+static uint32_t __seed;
+// bus of the workload: the model, recorded for the replay
+#define BUS_MODEL 0
+#define BUS_RECORD 1
+#define BUS_REPLAY 2
+
+static uint8_t __busMode;
+static uint8_t *__rec;
+static uint32_t __recLen;
+static uint32_t __recCap;
+static uint32_t __recPos;
+static uint32_t __spiHz = 50000000;
+
+typedef struct
+{
+    const char *name;
+    void (*prepare)(void);   // not measured
+    uint32_t (*run)(void);   // return payload bytes, 0 on error
+} Workload;
+
+//------------------- internal func -------------------
+
+static uint32_t Random(void)
+{
+    __seed = __seed * 1103515245UL + 12345UL;
+    return __seed >> 8;
+}
+
+static uint64_t CpuNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// the SPI hook of the driver
+static uint8_t Xfer(uint8_t dat)
+{
+    switch (__busMode)
+    {
+    case BUS_RECORD:
+        if (__recLen == __recCap)
+        {
+            __recCap = __recCap ? __recCap * 2 : 1 << 20;
+            __rec = realloc(__rec, __recCap);
+            if (__rec == NULL)
+            {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+        return __rec[__recLen++] = FlashEmu_Xfer(dat);
+    case BUS_REPLAY:
+        return __recPos < __recLen ? __rec[__recPos++] : 0xFF;
+    default:
+        return FlashEmu_Xfer(dat);
+    }
+}
+
+static void PrepareBlank(void)
+{
+    FlashEmu_Fill(0xFF);
+}
+
+static void PrepareData(void)
+{
+    memcpy(FlashEmu_Mem(), __data, REGION);
+}
+
+static uint32_t SeqRead(void)
+{
+    uint32_t addr;
+
+    for (addr = 0; addr < REGION; addr += sizeof(__buf))
+    {
+        if (DRV_ReadBytes(addr, __buf, sizeof(__buf)) != 0)
+            return 0;
+    }
+
+    return REGION;
+}
+
+static uint32_t RandRead(void)
+{
+    uint32_t i, n = 4096;
+
+    for (i = 0; i < n; i++)
+    {
+        if (DRV_ReadBytes(Random() % (REGION - 64), __buf, 64) != 0)
+            return 0;
+    }
+
+    return n * 64;
+}
+
+static uint32_t WriteAligned(void)
+{
+    uint32_t addr, size = REGION / 4;
+
+    for (addr = 0; addr < size; addr += 256)
+    {
+        if (!DRV_WriteBytes(addr, __data + addr, 256))
+            return 0;
+    }
+
+    return size;
+}
+
+static uint32_t WriteUnaligned(void)
+{
+    uint32_t addr, size = REGION / 4;
+
+    for (addr = 37; addr + 100 <= size + 37; addr += 100)
+    {
+        if (!DRV_WriteBytes(addr, __data + addr, 100))
+            return 0;
+    }
+
+    return addr - 37;
+}
+
+static uint32_t WriteByte(void)
+{
+    uint32_t addr, size = 4096;
+
+    for (addr = 0; addr < size; addr++)
+    {
+        if (!DRV_WriteByte(addr, __data[addr]))
+            return 0;
+    }
+
+    return size;
+}
+
+static uint32_t WriteWord(void)
+{
+    uint32_t addr, size = 4096;
+
+    for (addr = 0; addr < size; addr += 2)
+    {
+        if (!DRV_WriteWord(addr, (uint16_t)(__data[addr] | (__data[addr + 1] << 8))))
+            return 0;
+    }
+
+    return size;
+}
+
+static uint32_t OverwriteDirty(void)
+{
+    uint32_t addr, size = REGION / 4;
+
+    for (addr = 0; addr < size; addr += 4096)
+    {
+        if (!DRV_WriteBytes(addr, __data + REGION - size + addr, 4096))
+            return 0;
+    }
+
+    return size;
+}
+
+static uint32_t EraseSectors(void)
+{
+    uint32_t addr;
+
+    for (addr = 0; addr < REGION; addr += 4096)
+    {
+        if (DRV_Erase(addr, ERASE_SECTOR) != 0)
+            return 0;
+    }
+
+    return DRV_WaitReady() == 0 ? REGION : 0;
+}
+
+static uint32_t EraseBlocks(void)
+{
+    uint32_t addr;
+
+    for (addr = 0; addr < REGION; addr += 65536)
+    {
+        if (DRV_Erase(addr, ERASE_BLOCK) != 0)
+            return 0;
+    }
+
+    return DRV_WaitReady() == 0 ? REGION : 0;
+}
+
+static const Workload __workloads[] = {
+    {"seq_read", PrepareData, SeqRead},
+    {"rand_read", PrepareData, RandRead},
+    {"write_aligned", PrepareBlank, WriteAligned},
+    {"write_unaligned", PrepareBlank, WriteUnaligned},
+    {"write_byte", PrepareBlank, WriteByte},
+    {"write_word", PrepareBlank, WriteWord},
+    {"overwrite_dirty", PrepareData, OverwriteDirty},
+    {"erase_sectors", PrepareData, EraseSectors},
+    {"erase_blocks", PrepareData, EraseBlocks},
+};
+
+// run the workload, return the CPU time of 'run()'
+static uint64_t RunOnce(const Workload *w, uint8_t busMode, uint32_t *payload, uint64_t *virt, FlashEmu_Stats *st)
+{
+    uint64_t cpu;
+
+    *payload = 0;
+    __busMode = BUS_MODEL;
+    FlashEmu_Init(&PART, __spiHz, 1);
+
+    if (!DRV_Init(Xfer))
+    {
+        fprintf(stderr, "%s: init failed\n", w->name);
+        return 0;
+    }
+
+    __seed = 1;
+    srand(1); // the W25QXX read back samples use rand()
+    w->prepare();
+    DRV_WaitReady(); // status writes of init
+    FlashEmu_ResetStats();
+
+    // the driver is idle, both runs start in the same state
+    __busMode = busMode;
+    *virt = FlashEmu_Now();
+    cpu = CpuNs();
+    *payload = w->run();
+    cpu = CpuNs() - cpu;
+    *virt = FlashEmu_Now() - *virt;
+    __busMode = BUS_MODEL;
+
+    FlashEmu_GetStats(st);
+
+    return cpu;
+}
+
+static int Run(const Workload *w)
+{
+    FlashEmu_Stats st, replaySt;
+    uint64_t virt, replayVirt, cpu;
+    uint32_t payload;
+
+    __recLen = 0;
+    RunOnce(w, BUS_RECORD, &payload, &virt, &st);
+
+    if (payload == 0 || st.violations != 0)
+    {
+        fprintf(stderr, "%s: failed, %lu protocol violations\n", w->name, (unsigned long)st.violations);
+        return -1;
+    }
+
+    __recPos = 0;
+    cpu = RunOnce(w, BUS_REPLAY, &payload, &replayVirt, &replaySt);
+
+    if (payload == 0 || __recPos != __recLen)
+    {
+        fprintf(stderr, "%s: the replay took another path\n", w->name);
+        return -1;
+    }
+
+    printf("{\"driver\":\"%s\",\"part\":\"%s\",\"spi_hz\":%lu,\"workload\":\"%s\","
+           "\"payload\":%lu,\"virtual_us\":%.1f,\"mbps\":%.3f,\"spi_bytes\":%lu,\"spi_per_byte\":%.3f,"
+           "\"transactions\":%lu,\"status_polls\":%lu,\"programs\":%lu,\"erases\":%lu,\"cpu_ns\":%.2f}\n",
+           DRIVER, PART.name, (unsigned long)__spiHz, w->name,
+           (unsigned long)payload, virt / 1000.0, payload / (virt / 1000.0), (unsigned long)st.spiBytes,
+           (double)st.spiBytes / payload, (unsigned long)st.transactions, (unsigned long)st.statusPolls,
+           (unsigned long)st.pagePrograms,
+           (unsigned long)(st.sectorErases + st.halfBlockErases + st.blockErases + st.chipErases),
+           (double)cpu / payload);
+
+    return 0;
+}
+
+//-----------------------------------------------
+
+int main(int argc, char **argv)
+{
+    uint32_t i;
+    int err = 0;
+
+    if (argc > 1)
+        __spiHz = (uint32_t)strtoul(argv[1], NULL, 0);
+
+    for (i = 0; i < REGION; i++)
+        __data[i] = (uint8_t)(i * 7 + (i >> 9));
+
+    for (i = 0; i < sizeof(__workloads) / sizeof(__workloads[0]); i++)
+        err |= Run(&__workloads[i]);
+
+    return err ? 1 : 0;
+}
@@ -0,0 +1,16 @@
+#ifndef _H_BY25DXX_CONF
+#define _H_BY25DXX_CONF
+
+// host build: the chip is the model in "flash_emu.c"
+
+#include "flash_emu.h"
+
+#define BY25D40
+
+#define BY25DXX_CS_HIGH() FlashEmu_CS(1)
+#define BY25DXX_CS_LOW() FlashEmu_CS(0)
+
+#define BY25DXX_WP_HIGH() (void)0
+#define BY25DXX_WP_LOW() (void)0
+
+#endif
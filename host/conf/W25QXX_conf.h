@@ -0,0 +1,16 @@
+#ifndef _H_W25QXX_CONF
+#define _H_W25QXX_CONF
+
+// host build: the chip is the model in "flash_emu.c"
+
+#include "flash_emu.h"
+
+#define W25Q64
+
+#define W25QXX_CS_HIGH() FlashEmu_CS(1)
+#define W25QXX_CS_LOW() FlashEmu_CS(0)
+
+#define W25QXX_WP_HIGH() (void)0
+#define W25QXX_WP_LOW() (void)0
+
+#endif
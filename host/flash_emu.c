@@ -0,0 +1,424 @@
+#include "flash_emu.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGE_SIZE 256
+#define MAX_DIES 4
+
+#define STATUS_WR_BUSY 0x01
+#define STATUS_WR_ENABLE 0x02
+
+// the busy times are the typical ones of the drivers' tables
+//                                 name       vid   did   type  cap         size   tPP    tSE   tBE32   tBE64       tCE    tW
+const FlashEmu_Part FlashEmu_W25Q64 = {"W25Q64", 0xEF, 0x16, 0x40, 0x17, 0x800000UL, 400, 45000, 120000, 150000, 20000000, 10000};
+const FlashEmu_Part FlashEmu_BY25D40 = {"BY25D40", 0x68, 0x12, 0x40, 0x13, 0x80000UL, 600, 60000, 150000, 250000, 2000000, 5000};
+
+typedef struct
+{
+    uint8_t *mem;
+    uint8_t sr1;
+    uint8_t sr2;
+    uint8_t wel;
+    uint64_t busyUntil;
+} Die;
+
+static const FlashEmu_Part *__part;
+static Die __dies[MAX_DIES];
+static uint8_t __dieCount;
+static uint8_t __die;
+static uint64_t __byteTime; // ns per byte
+static uint64_t __now;
+static uint8_t __sleeping;
+static uint8_t __volatileEnable;
+static FlashEmu_Stats __stats;
+
+// transaction state
+static uint8_t __cs = 1;
+static uint32_t __pos;
+static uint8_t __cmd;
+static uint32_t __addr;
+static uint8_t __arg[4];
+static uint8_t __page[PAGE_SIZE];
+static uint8_t __pageUsed[PAGE_SIZE];
+
+static Die *Cur(void)
+{
+    return &__dies[__die];
+}
+
+static uint8_t IsBusy(Die *d)
+{
+    return __now < d->busyUntil;
+}
+
+static void SetBusy(Die *d, uint32_t us)
+{
+    d->busyUntil = __now + (uint64_t)us * 1000;
+}
+
+static uint8_t Status1(Die *d)
+{
+    uint8_t s = d->sr1 & 0xFC;
+    if (IsBusy(d))
+        s |= STATUS_WR_BUSY;
+    if (d->wel)
+        s |= STATUS_WR_ENABLE;
+    return s;
+}
+
+// W25Q style block protection (CMP=0 / CMP=1), returns 1 if addr is protected
+static uint8_t IsProtected(Die *d, uint32_t addr)
+{
+    uint8_t bp = (d->sr1 >> 2) & 0x07;
+    uint8_t tb = (d->sr1 >> 5) & 0x01;
+    uint8_t sec = (d->sr1 >> 6) & 0x01;
+    uint8_t cmp = (d->sr2 >> 6) & 0x01;
+    uint32_t unit, size, lo, hi;
+    uint8_t in;
+
+    if (__part->vendorID != 0xEF)
+        return 0; // only modelled for WinBond parts
+
+    if (bp == 0)
+        size = 0;
+    else if (bp == 7)
+        size = __part->size;
+    else if (sec)
+    {
+        size = 4096UL << (bp - 1);
+        if (size > 32768)
+            size = 32768;
+    }
+    else
+    {
+        unit = __part->size / 64; // 128KB for W25Q64
+        size = unit << (bp - 1);
+        if (size > __part->size)
+            size = __part->size;
+    }
+
+    if (tb)
+        lo = 0, hi = size;
+    else
+        lo = __part->size - size, hi = __part->size;
+
+    in = addr >= lo && addr < hi;
+
+    return cmp ? !in : in;
+}
+
+void FlashEmu_Init(const FlashEmu_Part *part, uint32_t spiHz, uint8_t dies)
+{
+    uint8_t i;
+
+    for (i = 0; i < __dieCount; i++)
+        free(__dies[i].mem);
+
+    __part = part;
+    __dieCount = dies ? dies : 1;
+    __die = 0;
+    __byteTime = 8000000000ULL / spiHz;
+    __now = 0;
+    __sleeping = 0;
+    __volatileEnable = 0;
+    __cs = 1;
+
+    for (i = 0; i < __dieCount; i++)
+    {
+        memset(&__dies[i], 0, sizeof(Die));
+        __dies[i].mem = malloc(part->size);
+        memset(__dies[i].mem, 0xFF, part->size);
+    }
+
+    memset(&__stats, 0, sizeof(__stats));
+}
+
+void FlashEmu_Fill(uint8_t value)
+{
+    uint8_t i;
+    for (i = 0; i < __dieCount; i++)
+        memset(__dies[i].mem, value, __part->size);
+}
+
+uint8_t *FlashEmu_Mem(void)
+{
+    return __dies[0].mem;
+}
+
+uint32_t FlashEmu_Size(void)
+{
+    return __part->size;
+}
+
+uint8_t FlashEmu_IsSleeping(void)
+{
+    return __sleeping;
+}
+
+void FlashEmu_Delay(uint64_t ns)
+{
+    __now += ns;
+}
+
+uint64_t FlashEmu_Now(void)
+{
+    return __now;
+}
+
+void FlashEmu_GetStats(FlashEmu_Stats *stats)
+{
+    *stats = __stats;
+}
+
+void FlashEmu_ResetStats(void)
+{
+    memset(&__stats, 0, sizeof(__stats));
+}
+
+static void Violation(void)
+{
+    __stats.violations++;
+}
+
+// end of a transaction, execute write type commands
+static void Finish(void)
+{
+    Die *d = Cur();
+    uint32_t i, base, size;
+
+    switch (__cmd)
+    {
+    case 0x06:
+        if (__pos == 1)
+            d->wel = 1;
+        break;
+    case 0x04:
+        d->wel = 0;
+        break;
+    case 0x50:
+        __volatileEnable = 1;
+        break;
+    case 0x01:
+    case 0x31:
+        if (__pos < 2)
+            break;
+        if (!d->wel && !__volatileEnable)
+        {
+            Violation();
+            break;
+        }
+        if (__cmd == 0x01)
+        {
+            d->sr1 = __arg[0] & 0xFC;
+            if (__pos >= 3)
+                d->sr2 = __arg[1];
+        }
+        else
+            d->sr2 = __arg[0];
+        if (!__volatileEnable)
+        {
+            SetBusy(d, __part->tW);
+            __stats.statusWrites++;
+        }
+        d->wel = 0;
+        __volatileEnable = 0;
+        break;
+    case 0x02:
+        if (__pos < 4)
+            break;
+        if (!d->wel)
+        {
+            Violation();
+            break;
+        }
+        base = __addr & ~(PAGE_SIZE - 1);
+        size = 0;
+        for (i = 0; i < PAGE_SIZE; i++)
+        {
+            if (!__pageUsed[i])
+                continue;
+            size++;
+            if (!IsProtected(d, base + i))
+                d->mem[base + i] &= __page[i];
+        }
+        d->wel = 0;
+        SetBusy(d, __part->tPP);
+        __stats.pagePrograms++;
+        __stats.programBytes += size;
+        break;
+    case 0x20:
+    case 0x52:
+    case 0xD8:
+        if (__pos != 4)
+            break;
+        if (!d->wel)
+        {
+            Violation();
+            break;
+        }
+        size = __cmd == 0x20 ? 4096 : __cmd == 0x52 ? 32768 : 65536;
+        base = __addr & ~(size - 1);
+        if (!IsProtected(d, base) && !IsProtected(d, base + size - 1))
+            memset(d->mem + base, 0xFF, size);
+        d->wel = 0;
+        if (__cmd == 0x20)
+            SetBusy(d, __part->tSE), __stats.sectorErases++;
+        else if (__cmd == 0x52)
+            SetBusy(d, __part->tBE32), __stats.halfBlockErases++;
+        else
+            SetBusy(d, __part->tBE64), __stats.blockErases++;
+        break;
+    case 0x60:
+    case 0xC7:
+        if (__pos != 1)
+            break; // must be a single byte command
+        if (!d->wel)
+        {
+            Violation();
+            break;
+        }
+        memset(d->mem, 0xFF, __part->size);
+        d->wel = 0;
+        SetBusy(d, __part->tCE);
+        __stats.chipErases++;
+        break;
+    case 0xB9:
+        __sleeping = 1;
+        break;
+    case 0xAB:
+        __sleeping = 0;
+        break;
+    case 0xC2:
+        if (__pos >= 2 && __arg[0] < __dieCount)
+            __die = __arg[0];
+        break;
+    default:
+        break;
+    }
+}
+
+void FlashEmu_CS(uint8_t level)
+{
+    if (level == __cs)
+        return;
+
+    __cs = level;
+
+    if (level == 0) // begin
+    {
+        __pos = 0;
+        __cmd = 0;
+        __addr = 0;
+        memset(__pageUsed, 0, sizeof(__pageUsed));
+        __stats.transactions++;
+    }
+    else
+    {
+        Finish();
+    }
+}
+
+static uint8_t UsesAddr(uint8_t cmd)
+{
+    switch (cmd)
+    {
+    case 0x02:
+    case 0x03:
+    case 0x0B:
+    case 0x20:
+    case 0x52:
+    case 0xD8:
+    case 0x90:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+uint8_t FlashEmu_Xfer(uint8_t dat)
+{
+    Die *d = Cur();
+    uint8_t out = 0xFF;
+    uint32_t idx;
+
+    __now += __byteTime;
+    __stats.spiBytes++;
+
+    if (__cs)
+    {
+        Violation(); // clocking without chip select
+        return 0xFF;
+    }
+
+    if (__pos == 0)
+    {
+        __cmd = dat;
+        __pos = 1;
+
+        if (__sleeping && dat != 0xAB)
+            Violation();
+        else if (IsBusy(d) && dat != 0x05 && dat != 0x35 && dat != 0xC2)
+            Violation();
+        return 0xFF;
+    }
+
+    if (__sleeping && __cmd != 0xAB)
+        return 0xFF;
+
+    if (UsesAddr(__cmd) && __pos < 4)
+    {
+        __addr = (__addr << 8) | dat;
+        __pos++;
+        if (__pos == 4)
+            __addr %= __part->size;
+        return 0xFF;
+    }
+
+    idx = __pos - (UsesAddr(__cmd) ? 4 : 1); // payload index
+    __pos++;
+
+    switch (__cmd)
+    {
+    case 0x05:
+        __stats.statusPolls++;
+        out = Status1(d);
+        break;
+    case 0x35:
+        out = d->sr2;
+        break;
+    case 0x01:
+    case 0x31:
+    case 0xC2:
+        if (idx < sizeof(__arg))
+            __arg[idx] = dat;
+        break;
+    case 0x03:
+        out = d->mem[(__addr + idx) % __part->size];
+        break;
+    case 0x0B:
+        if (idx > 0)
+            out = d->mem[(__addr + idx - 1) % __part->size];
+        break;
+    case 0x02:
+        idx = (__addr + idx) % PAGE_SIZE;
+        __page[idx] = dat;
+        __pageUsed[idx] = 1;
+        break;
+    case 0x90:
+        out = (idx & 1) ? __part->devID : __part->vendorID;
+        break;
+    case 0x9F:
+        out = idx == 0 ? __part->vendorID : idx == 1 ? __part->memType : __part->capacity;
+        break;
+    case 0x4B:
+        out = idx < 4 ? 0xFF : (uint8_t)(0xA0 + idx);
+        break;
+    case 0xAB:
+        out = idx >= 3 ? __part->devID : 0xFF;
+        break;
+    default:
+        break;
+    }
+
+    return out;
+}
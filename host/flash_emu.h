@@ -0,0 +1,66 @@
+#ifndef _H_FLASH_EMU
+#define _H_FLASH_EMU
+
+#include <stdint.h>
+
+/**
+ * SPI NOR flash model for host builds
+ *
+ * the model sits behind the driver's SPI hook and CS macros, keeps
+ * the array in RAM and advances a virtual clock for every byte on the
+ * bus and for every program/erase (typical datasheet times)
+*/
+
+typedef struct
+{
+    const char *name;
+    uint8_t vendorID;
+    uint8_t devID;
+    uint8_t memType;
+    uint8_t capacity;
+    uint32_t size;
+
+    // typical busy times, us
+    uint32_t tPP;
+    uint32_t tSE;
+    uint32_t tBE32;
+    uint32_t tBE64;
+    uint32_t tCE;
+    uint32_t tW;
+} FlashEmu_Part;
+
+typedef struct
+{
+    uint64_t spiBytes;
+    uint64_t transactions;
+    uint64_t statusPolls;
+    uint64_t pagePrograms;
+    uint64_t programBytes;
+    uint64_t sectorErases;
+    uint64_t halfBlockErases;
+    uint64_t blockErases;
+    uint64_t chipErases;
+    uint64_t statusWrites;
+    uint64_t violations; // commands sent while busy, programs without WEL ...
+} FlashEmu_Stats;
+
+extern const FlashEmu_Part FlashEmu_W25Q64;
+extern const FlashEmu_Part FlashEmu_BY25D40;
+
+void FlashEmu_Init(const FlashEmu_Part *part, uint32_t spiHz, uint8_t dies);
+void FlashEmu_Fill(uint8_t value);
+
+void FlashEmu_CS(uint8_t level);
+uint8_t FlashEmu_Xfer(uint8_t dat);
+
+void FlashEmu_Delay(uint64_t ns); // let virtual time pass (CPU sleeping/working)
+uint64_t FlashEmu_Now(void);      // virtual time, ns
+
+uint8_t *FlashEmu_Mem(void);
+uint32_t FlashEmu_Size(void);
+uint8_t FlashEmu_IsSleeping(void);
+
+void FlashEmu_GetStats(FlashEmu_Stats *stats);
+void FlashEmu_ResetStats(void);
+
+#endif
@@ -0,0 +1,575 @@
+/**
+ * *****************************************************
+ *
+ * image builder and update planner
+ *
+ * builds the new image from one or more files, compares it with what the
+ * device holds and writes a plan with only the erases and page programs
+ * needed to get there, for the executor in "W25QXX_plan.c".
+ *
+ * the device content is given as the old image (-o) or as a map of sector
+ * checksums (-m), one line per sector: "addr crc" in hex, the CRC32 of the
+ * sector as 'W25QXX_SUM_ChecksumRange(addr, 4096, W25QXX_SUM_CRC32, ...)'
+ * gives it. sectors missing in the map are rewritten. without both every
+ * sector is rewritten.
+ *
+ * the image is padded with 0xFF to whole sectors. a page is programmed
+ * over the old data if it only clears bits, the other sectors are erased.
+ * erase sizes (4K/32K/64K) are chosen per block by the typical times of
+ * the part: a larger erase wins when it's faster than the sector erases,
+ * with the pages it wipes programmed again.
+ *
+ * prints one JSON object with the plan and the time it takes on the chip
+ * (est_ms), compared with writing the whole image with
+ * 'W25QXX_WriteBytes()' (full_ms).
+ *
+ * usage: plan [-p w25q64|by25d40] [-s spi clock, Hz] [-a image addr]
+ *             [-o old.bin | -m map.txt] [-b built.bin] [-O plan.bin]
+ *             file[@offset] ...
+ *
+ * *****************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_emu.h"
+#include "W25QXX.h"
+#include "W25QXX_sum.h"
+#include "BY25DXX.h"
+
+#define PLAN_MAGIC 0x3150464EUL // "NFP1"
+#define PLAN_PROGRAM 0x02
+
+// sector state
+#define SECTOR_SAME 0  // nothing to do
+#define SECTOR_KEEP 1  // changed pages only clear bits
+#define SECTOR_ERASE 2 // must be erased
+
+typedef struct
+{
+    const char *name;
+    const FlashEmu_Part *part; // size and typical times
+    uint32_t pageSize;
+    uint32_t sectorSize;
+    uint32_t halfBlockSize;
+    uint32_t blockSize;
+    uint8_t eraseSector; // erase opcodes of the driver
+    uint8_t eraseHalfBlock;
+    uint8_t eraseBlock;
+} Geometry;
+
+static const Geometry __geometry[] = {
+    {"w25q64", &FlashEmu_W25Q64, W25QXX_PAGE_SIZE, W25QXX_SECTOR_SIZE, W25QXX_HALF_BLOCK_SIZE, W25QXX_BLOCK_SIZE,
+     W25QXX_ERASE_SECTOR, W25QXX_ERASE_HALF_BLOCK, W25QXX_ERASE_BLOCK},
+    {"by25d40", &FlashEmu_BY25D40, BY25DXX_PAGE_SIZE, BY25DXX_SECTOR_SIZE, BY25DXX_HALF_BLOCK_SIZE, BY25DXX_BLOCK_SIZE,
+     BY25DXX_ERASE_SECTOR, BY25DXX_ERASE_HALF_BLOCK, BY25DXX_ERASE_BLOCK}};
+
+static const Geometry *__geo = &__geometry[0];
+static double __pageUs; // typical time of a page program, with the transfer
+static double __byteUs; // SPI time of one byte
+
+static uint8_t *__new, *__old; // image and device content, 'len' bytes
+static uint8_t *__state;       // per sector
+static uint8_t *__erase;       // per sector, erase opcode of a unit starting there
+static uint8_t *__erased;      // per sector, wiped by a unit
+static uint32_t __addr, __len, __sectors;
+
+static uint8_t *__plan;
+static uint32_t __planLen, __planCap, __ops;
+
+//------------------- internal func -------------------
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: plan [-p w25q64|by25d40] [-s spi clock, Hz] [-a image addr]\n"
+                    "            [-o old.bin | -m map.txt] [-b built.bin] [-O plan.bin] file[@offset] ...\n");
+    exit(1);
+}
+
+static void *Alloc(size_t size)
+{
+    void *p = calloc(1, size);
+
+    if (p == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+static uint8_t *ReadFile(const char *path, uint32_t *size)
+{
+    uint8_t *buf;
+    long n;
+    FILE *f;
+
+    f = fopen(path, "rb");
+    if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (n = ftell(f)) < 0)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    rewind(f);
+    buf = Alloc((size_t)n + 1);
+
+    if (fread(buf, 1, (size_t)n, f) != (size_t)n)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    fclose(f);
+    *size = (uint32_t)n;
+
+    return buf;
+}
+
+static void WriteFile(const char *path, const uint8_t *buf, uint32_t len)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL || fwrite(buf, 1, len, f) != len || fclose(f) != 0)
+    {
+        perror(path);
+        exit(1);
+    }
+}
+
+static uint8_t IsBlank(const uint8_t *buf, uint32_t len)
+{
+    while (len--)
+    {
+        if (*buf++ != 0xFF)
+            return 0;
+    }
+
+    return 1;
+}
+
+// the device content from the checksum map, unknown sectors are erased
+static void LoadMap(const char *path)
+{
+    unsigned long addr, crc;
+    uint32_t s, blankCrc;
+    uint8_t *blank;
+    FILE *f;
+
+    f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    blank = Alloc(__geo->sectorSize);
+    memset(blank, 0xFF, __geo->sectorSize);
+    blankCrc = W25QXX_SUM_Crc32(0, blank, __geo->sectorSize);
+
+    for (s = 0; s < __sectors; s++)
+        __state[s] = SECTOR_ERASE;
+
+    while (fscanf(f, "%lx %lx", &addr, &crc) == 2)
+    {
+        if (addr < __addr || addr - __addr >= __len || (addr - __addr) % __geo->sectorSize != 0)
+            continue;
+
+        s = (uint32_t)(addr - __addr) / __geo->sectorSize;
+
+        if (crc == W25QXX_SUM_Crc32(0, __new + s * __geo->sectorSize, __geo->sectorSize))
+        {
+            memcpy(__old + s * __geo->sectorSize, __new + s * __geo->sectorSize, __geo->sectorSize);
+            __state[s] = SECTOR_SAME;
+        }
+        else if (crc == blankCrc)
+        {
+            __state[s] = SECTOR_SAME; // old is 0xFF already, the pages decide
+        }
+    }
+
+    fclose(f);
+    free(blank);
+}
+
+// sector states from the page contents, on top of what the map says
+static void Compare(void)
+{
+    uint32_t s, p, i, offset;
+
+    for (s = 0; s < __sectors; s++)
+    {
+        if (__state[s] == SECTOR_ERASE)
+            continue;
+
+        for (p = 0; p < __geo->sectorSize; p += __geo->pageSize)
+        {
+            offset = s * __geo->sectorSize + p;
+
+            if (memcmp(__new + offset, __old + offset, __geo->pageSize) == 0)
+                continue;
+
+            __state[s] = SECTOR_KEEP;
+
+            for (i = 0; i < __geo->pageSize; i++)
+            {
+                if (__new[offset + i] & ~__old[offset + i])
+                    break;
+            }
+
+            if (i < __geo->pageSize)
+            {
+                __state[s] = SECTOR_ERASE;
+                break;
+            }
+        }
+    }
+}
+
+// pages to program in the sector, after an erase or over the old data
+static uint32_t Pages(uint32_t s, uint8_t erased)
+{
+    uint32_t p, offset, n = 0;
+
+    for (p = 0; p < __geo->sectorSize; p += __geo->pageSize)
+    {
+        offset = s * __geo->sectorSize + p;
+
+        if (erased ? !IsBlank(__new + offset, __geo->pageSize)
+                   : memcmp(__new + offset, __old + offset, __geo->pageSize) != 0)
+            n++;
+    }
+
+    return n;
+}
+
+// typical time of [first, first + num) sectors with sector erases where needed
+static double SectorsCost(uint32_t first, uint32_t num)
+{
+    double us = 0;
+    uint32_t s;
+
+    for (s = first; s < first + num; s++)
+    {
+        if (__state[s] == SECTOR_ERASE)
+            us += __geo->part->tSE + Pages(s, 1) * __pageUs;
+        else
+            us += Pages(s, 0) * __pageUs;
+    }
+
+    return us;
+}
+
+// typical time of [first, first + num) sectors wiped by one erase
+static double UnitCost(uint32_t first, uint32_t num, uint32_t eraseUs)
+{
+    double us = eraseUs;
+    uint32_t s;
+
+    for (s = first; s < first + num; s++)
+        us += Pages(s, 1) * __pageUs;
+
+    return us;
+}
+
+static void Choose(uint32_t first, uint32_t num, uint8_t type)
+{
+    uint32_t s;
+
+    __erase[first] = type;
+
+    for (s = first; s < first + num; s++)
+        __erased[s] = 1;
+}
+
+static void ChooseSectors(uint32_t first, uint32_t num)
+{
+    uint32_t s;
+
+    for (s = first; s < first + num; s++)
+    {
+        if (__state[s] == SECTOR_ERASE)
+            Choose(s, 1, __geo->eraseSector);
+    }
+}
+
+// best of a half block erase and sector erases, the cost is returned
+static double PlanHalf(uint32_t first, uint8_t apply)
+{
+    uint32_t num = __geo->halfBlockSize / __geo->sectorSize;
+    double sectors = SectorsCost(first, num);
+    double unit = UnitCost(first, num, __geo->part->tBE32);
+
+    if (apply)
+    {
+        if (unit < sectors)
+            Choose(first, num, __geo->eraseHalfBlock);
+        else
+            ChooseSectors(first, num);
+    }
+
+    return unit < sectors ? unit : sectors;
+}
+
+// erase units for all sectors, larger ones only where they lie in the image
+static void PlanErases(void)
+{
+    uint32_t perBlock = __geo->blockSize / __geo->sectorSize;
+    uint32_t perHalf = __geo->halfBlockSize / __geo->sectorSize;
+    uint32_t s = 0, base;
+    double halves;
+
+    while (s < __sectors)
+    {
+        base = __addr / __geo->sectorSize + s;
+
+        if (base % perBlock == 0 && s + perBlock <= __sectors)
+        {
+            halves = PlanHalf(s, 0) + PlanHalf(s + perHalf, 0);
+
+            if (UnitCost(s, perBlock, __geo->part->tBE64) < halves)
+            {
+                Choose(s, perBlock, __geo->eraseBlock);
+            }
+            else
+            {
+                PlanHalf(s, 1);
+                PlanHalf(s + perHalf, 1);
+            }
+
+            s += perBlock;
+        }
+        else if (base % perHalf == 0 && s + perHalf <= __sectors)
+        {
+            PlanHalf(s, 1);
+            s += perHalf;
+        }
+        else
+        {
+            ChooseSectors(s, 1);
+            s++;
+        }
+    }
+}
+
+static void Emit(const uint8_t *buf, uint32_t len)
+{
+    if (__planLen + len > __planCap)
+    {
+        __planCap = (__planLen + len) * 2;
+        __plan = realloc(__plan, __planCap);
+        if (__plan == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    memcpy(__plan + __planLen, buf, len);
+    __planLen += len;
+}
+
+static void EmitU32(uint32_t val)
+{
+    uint8_t buf[4] = {(uint8_t)val, (uint8_t)(val >> 8), (uint8_t)(val >> 16), (uint8_t)(val >> 24)};
+
+    Emit(buf, sizeof(buf));
+}
+
+static void EmitOp(uint8_t op, uint32_t addr)
+{
+    Emit(&op, 1);
+    EmitU32(addr);
+    __ops++;
+}
+
+//-----------------------------------------------
+
+int main(int argc, char **argv)
+{
+    const char *oldPath = NULL, *mapPath = NULL, *builtPath = NULL, *planPath = "plan.bin";
+    uint32_t spiHz = 50000000, size, offset, end, s, p, first, last, i;
+    uint32_t eraseNum[3] = {0, 0, 0}, programs = 0, programBytes = 0, oldSectors = 0;
+    uint8_t *buf, len;
+    double estUs = 0, fullUs;
+    char *at;
+    int argi, pieces = 0;
+
+    for (argi = 1; argi < argc && argv[argi][0] == '-'; argi++)
+    {
+        if (argi + 1 >= argc)
+            Usage();
+
+        if (!strcmp(argv[argi], "-p"))
+        {
+            argi++;
+            for (i = 0; i < sizeof(__geometry) / sizeof(__geometry[0]); i++)
+            {
+                if (!strcmp(argv[argi], __geometry[i].name))
+                    break;
+            }
+            if (i == sizeof(__geometry) / sizeof(__geometry[0]))
+                Usage();
+            __geo = &__geometry[i];
+        }
+        else if (!strcmp(argv[argi], "-s"))
+            spiHz = (uint32_t)strtoul(argv[++argi], NULL, 0);
+        else if (!strcmp(argv[argi], "-a"))
+            __addr = (uint32_t)strtoul(argv[++argi], NULL, 0);
+        else if (!strcmp(argv[argi], "-o") && mapPath == NULL)
+            oldPath = argv[++argi];
+        else if (!strcmp(argv[argi], "-m") && oldPath == NULL)
+            mapPath = argv[++argi];
+        else if (!strcmp(argv[argi], "-b"))
+            builtPath = argv[++argi];
+        else if (!strcmp(argv[argi], "-O"))
+            planPath = argv[++argi];
+        else
+            Usage();
+    }
+
+    if (argi == argc || __addr % __geo->sectorSize != 0 || __addr >= __geo->part->size)
+        Usage();
+
+    // build the image, later files overwrite earlier ones
+    __new = Alloc(__geo->part->size);
+    memset(__new, 0xFF, __geo->part->size);
+
+    for (; argi < argc; argi++, pieces++)
+    {
+        at = strchr(argv[argi], '@');
+        offset = 0;
+        if (at != NULL)
+        {
+            *at = '\0';
+            offset = (uint32_t)strtoul(at + 1, NULL, 0);
+        }
+
+        buf = ReadFile(argv[argi], &size);
+        if (offset > __geo->part->size - __addr || size > __geo->part->size - __addr - offset)
+        {
+            fprintf(stderr, "%s: doesn't fit into %s\n", argv[argi], __geo->part->name);
+            return 1;
+        }
+
+        memcpy(__new + offset, buf, size);
+        free(buf);
+
+        end = offset + size;
+        if (end > __len)
+            __len = end;
+    }
+
+    if (__len == 0)
+    {
+        fprintf(stderr, "the image is empty\n");
+        return 1;
+    }
+
+    __len = (__len + __geo->sectorSize - 1) / __geo->sectorSize * __geo->sectorSize;
+    __sectors = __len / __geo->sectorSize;
+    __pageUs = __geo->part->tPP + (5.0 + __geo->pageSize) * 8e6 / spiHz;
+    __byteUs = 8e6 / spiHz;
+
+    if (builtPath != NULL)
+        WriteFile(builtPath, __new, __len);
+
+    __old = Alloc(__len);
+    memset(__old, 0xFF, __len);
+    __state = Alloc(__sectors);
+    __erase = Alloc(__sectors);
+    __erased = Alloc(__sectors);
+
+    if (oldPath != NULL)
+    {
+        // the device is assumed blank after the end of the old image
+        buf = ReadFile(oldPath, &size);
+        memcpy(__old, buf, size < __len ? size : __len);
+        free(buf);
+    }
+    else if (mapPath != NULL)
+    {
+        LoadMap(mapPath);
+    }
+    else
+    {
+        memset(__state, SECTOR_ERASE, __sectors);
+    }
+
+    Compare();
+    PlanErases();
+
+    // the header, 'ops' is patched at the end
+    EmitU32(PLAN_MAGIC);
+    EmitU32(__addr);
+    EmitU32(__len);
+    EmitU32(W25QXX_SUM_Crc32(0, __new, __len));
+    EmitU32(0);
+
+    for (s = 0; s < __sectors; s++)
+    {
+        if (__erase[s] != 0)
+        {
+            EmitOp(__erase[s], __addr + s * __geo->sectorSize);
+
+            if (__erase[s] == __geo->eraseSector)
+                eraseNum[0]++, estUs += __geo->part->tSE;
+            else if (__erase[s] == __geo->eraseHalfBlock)
+                eraseNum[1]++, estUs += __geo->part->tBE32;
+            else
+                eraseNum[2]++, estUs += __geo->part->tBE64;
+        }
+
+        if (__state[s] != SECTOR_SAME || !IsBlank(__old + s * __geo->sectorSize, __geo->sectorSize))
+            oldSectors++;
+
+        for (p = s * __geo->sectorSize; p < (s + 1) * __geo->sectorSize; p += __geo->pageSize)
+        {
+            // the bytes to program, over 0xFF or the old data
+            first = __geo->pageSize;
+            last = 0;
+
+            for (i = 0; i < __geo->pageSize; i++)
+            {
+                if (__erased[s] ? __new[p + i] != 0xFF : __new[p + i] != __old[p + i])
+                {
+                    if (first == __geo->pageSize)
+                        first = i;
+                    last = i;
+                }
+            }
+
+            if (first == __geo->pageSize)
+                continue;
+
+            EmitOp(PLAN_PROGRAM, __addr + p + first);
+            len = (uint8_t)(last - first);
+            Emit(&len, 1);
+            Emit(__new + p + first, last - first + 1);
+
+            programs++;
+            programBytes += last - first + 1;
+            estUs += __geo->part->tPP + (last - first + 6) * __byteUs;
+        }
+    }
+
+    for (i = 0; i < 4; i++)
+        __plan[16 + i] = (uint8_t)(__ops >> (i * 8));
+
+    WriteFile(planPath, __plan, __planLen);
+
+    // 'W25QXX_WriteBytes()' erases every used sector and programs every page
+    fullUs = (double)oldSectors * __geo->part->tSE + (double)(__len / __geo->pageSize) * __pageUs;
+
+    printf("{\"part\":\"%s\",\"files\":%d,\"addr\":%lu,\"len\":%lu,\"erase_4k\":%lu,\"erase_32k\":%lu,"
+           "\"erase_64k\":%lu,\"programs\":%lu,\"program_bytes\":%lu,\"plan_bytes\":%lu,"
+           "\"est_ms\":%.1f,\"full_ms\":%.1f}\n",
+           __geo->part->name, pieces, (unsigned long)__addr, (unsigned long)__len,
+           (unsigned long)eraseNum[0], (unsigned long)eraseNum[1], (unsigned long)eraseNum[2],
+           (unsigned long)programs, (unsigned long)programBytes, (unsigned long)__planLen,
+           estUs / 1000.0, fullUs / 1000.0);
+
+    return 0;
+}
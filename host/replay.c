@@ -0,0 +1,271 @@
+/**
+ * *****************************************************
+ *
+ * replay a bus trace on the flash model
+ *
+ * reads the records dumped with 'W25QXX_TraceDump()'/'BY25DXX_TraceDump()',
+ * one per line: "time cmd len duration" (cmd in hex), and sends them to
+ * the model with the recorded gaps. the 32 bit tick may wrap during the
+ * trace, gaps are taken between consecutive records. prints one JSON
+ * object per command class and a summary:
+ *
+ *   recorded_us  CS low time on the target (duration), 'saturated'
+ *                durations hit the 16 bit limit and count as 0xFFFF
+ *   bus_us       time on the bus in the model, for the same commands
+ *   busy_us      typical busy time started by the class (program/erase/tW)
+ *
+ * the summary has the time from the first to the last record, 'trace_us'
+ * as recorded and 'total_us' in the model, and the wasted work:
+ *   busy_polls   status reads answered busy
+ *   idle_polls   status reads while nothing was started since the last
+ *                ready answer, the wait wasn't needed
+ *   unused_wren  write enable not followed by a write command
+ *   violations   commands the model rejected (busy, no WEL ...)
+ *
+ * usage: replay [-p w25q64|by25d40] [-s spi clock, Hz] [-t ns per tick] trace.txt
+ *
+ * *****************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_emu.h"
+
+#define STATUS_WR_BUSY 0x01
+
+typedef enum
+{
+    CLASS_READ = 0,
+    CLASS_PROGRAM,
+    CLASS_ERASE,
+    CLASS_STATUS_READ,
+    CLASS_STATUS_WRITE,
+    CLASS_WRITE_ENABLE,
+    CLASS_POWER,
+    CLASS_ID,
+    CLASS_OTHER,
+    CLASS_MAX
+} Class;
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t busNs;
+    uint64_t recordedNs;
+    uint64_t saturated;
+    uint64_t busyUs;
+} ClassStats;
+
+static const char *__className[CLASS_MAX] = {
+    "read", "program", "erase", "status_read", "status_write", "write_enable", "power", "id", "other"};
+
+static ClassStats __stats[CLASS_MAX];
+
+//------------------- internal func -------------------
+
+static Class Classify(uint8_t op)
+{
+    switch (op)
+    {
+    case 0x03:
+    case 0x0B:
+        return CLASS_READ;
+    case 0x02:
+        return CLASS_PROGRAM;
+    case 0x20:
+    case 0x52:
+    case 0xD8:
+    case 0x60:
+    case 0xC7:
+        return CLASS_ERASE;
+    case 0x05:
+    case 0x35:
+        return CLASS_STATUS_READ;
+    case 0x01:
+    case 0x31:
+    case 0x50:
+        return CLASS_STATUS_WRITE;
+    case 0x06:
+    case 0x04:
+        return CLASS_WRITE_ENABLE;
+    case 0xB9:
+    case 0xAB:
+        return CLASS_POWER;
+    case 0x90:
+    case 0x9F:
+    case 0x4B:
+        return CLASS_ID;
+    default:
+        return CLASS_OTHER;
+    }
+}
+
+// typical busy time started by a command, us
+static uint32_t BusyTime(const FlashEmu_Part *part, uint8_t op)
+{
+    switch (op)
+    {
+    case 0x02:
+        return part->tPP;
+    case 0x20:
+        return part->tSE;
+    case 0x52:
+        return part->tBE32;
+    case 0xD8:
+        return part->tBE64;
+    case 0x60:
+    case 0xC7:
+        return part->tCE;
+    case 0x01:
+    case 0x31:
+        return part->tW;
+    default:
+        return 0;
+    }
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: replay [-p w25q64|by25d40] [-s spi clock, Hz] [-t ns per tick] trace.txt\n");
+    exit(2);
+}
+
+//-----------------------------------------------
+
+int main(int argc, char **argv)
+{
+    const FlashEmu_Part *part = &FlashEmu_W25Q64;
+    uint32_t spiHz = 50000000, tickNs = 1000;
+    unsigned long time, cmd, len, duration;
+    uint32_t prevTime = 0;
+    uint64_t ticks = 0; // since the first record
+    uint64_t records = 0, busyPolls = 0, idlePolls = 0, unusedWren = 0;
+    uint64_t wastedNs = 0, start, pollStart, target, i;
+    uint8_t op, out, pending = 1, wren = 0;
+    const char *path = NULL;
+    FlashEmu_Stats st;
+    Class cls;
+    FILE *f;
+    int argi;
+
+    for (argi = 1; argi < argc; argi++)
+    {
+        if (!strcmp(argv[argi], "-p") && argi + 1 < argc)
+        {
+            argi++;
+            if (!strcmp(argv[argi], "w25q64"))
+                part = &FlashEmu_W25Q64;
+            else if (!strcmp(argv[argi], "by25d40"))
+                part = &FlashEmu_BY25D40;
+            else
+                Usage();
+        }
+        else if (!strcmp(argv[argi], "-s") && argi + 1 < argc)
+            spiHz = (uint32_t)strtoul(argv[++argi], NULL, 0);
+        else if (!strcmp(argv[argi], "-t") && argi + 1 < argc)
+            tickNs = (uint32_t)strtoul(argv[++argi], NULL, 0);
+        else if (argv[argi][0] != '-' && path == NULL)
+            path = argv[argi];
+        else
+            Usage();
+    }
+
+    if (path == NULL)
+        Usage();
+
+    f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+
+    FlashEmu_Init(part, spiHz, 1);
+
+    while (fscanf(f, "%lu %lx %lu %lu", &time, &cmd, &len, &duration) == 4)
+    {
+        if (records++ != 0)
+            ticks += (uint32_t)((uint32_t)time - prevTime);
+        prevTime = (uint32_t)time;
+
+        // keep the recorded gaps, the chip finishes its work meanwhile
+        target = ticks * tickNs;
+        if (target > FlashEmu_Now())
+            FlashEmu_Delay(target - FlashEmu_Now());
+
+        op = (uint8_t)(cmd >> 24);
+        cls = Classify(op);
+
+        if (wren && cls != CLASS_PROGRAM && cls != CLASS_ERASE && cls != CLASS_STATUS_WRITE)
+            unusedWren++;
+        wren = op == 0x06;
+
+        start = FlashEmu_Now();
+        pollStart = start;
+        out = 0;
+
+        FlashEmu_CS(0);
+        FlashEmu_Xfer(op);
+
+        for (i = 0; i < len || (op == 0x05 && len > 1 && (out & STATUS_WR_BUSY)); i++)
+        {
+            // a poll with CS held ends when the chip is ready, even if the model is slower
+            out = FlashEmu_Xfer(i < 3 ? (uint8_t)(cmd >> (16 - i * 8)) : 0x00);
+
+            if (op != 0x05)
+                continue;
+
+            if (out & STATUS_WR_BUSY)
+            {
+                busyPolls++;
+                wastedNs += FlashEmu_Now() - pollStart;
+            }
+            else
+            {
+                if (!pending)
+                    idlePolls++, wastedNs += FlashEmu_Now() - pollStart;
+                pending = 0;
+            }
+
+            pollStart = FlashEmu_Now();
+        }
+
+        FlashEmu_CS(1);
+
+        if (BusyTime(part, op) != 0)
+            pending = 1;
+
+        __stats[cls].count++;
+        __stats[cls].bytes += i + 1;
+        __stats[cls].busNs += FlashEmu_Now() - start;
+        __stats[cls].recordedNs += (uint64_t)duration * tickNs;
+        __stats[cls].saturated += duration >= 0xFFFF;
+        __stats[cls].busyUs += BusyTime(part, op);
+    }
+
+    fclose(f);
+
+    for (cls = 0; cls < CLASS_MAX; cls++)
+    {
+        if (__stats[cls].count == 0)
+            continue;
+
+        printf("{\"class\":\"%s\",\"transactions\":%lu,\"bytes\":%lu,\"recorded_us\":%.1f,\"saturated\":%lu,"
+               "\"bus_us\":%.1f,\"busy_us\":%lu}\n",
+               __className[cls], (unsigned long)__stats[cls].count, (unsigned long)__stats[cls].bytes,
+               __stats[cls].recordedNs / 1000.0, (unsigned long)__stats[cls].saturated,
+               __stats[cls].busNs / 1000.0, (unsigned long)__stats[cls].busyUs);
+    }
+
+    FlashEmu_GetStats(&st);
+
+    printf("{\"part\":\"%s\",\"spi_hz\":%lu,\"records\":%lu,\"trace_us\":%.1f,\"total_us\":%.1f,\"busy_polls\":%lu,"
+           "\"idle_polls\":%lu,\"unused_wren\":%lu,\"wasted_us\":%.1f,\"violations\":%lu}\n",
+           part->name, (unsigned long)spiHz, (unsigned long)records, ticks * (double)tickNs / 1000.0, FlashEmu_Now() / 1000.0,
+           (unsigned long)busyPolls, (unsigned long)idlePolls, (unsigned long)unusedWren,
+           wastedNs / 1000.0, (unsigned long)st.violations);
+
+    return 0;
+}